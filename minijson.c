@@ -1,4 +1,5 @@
 #include "minijson.h"
+#include "minijson_internal.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
@@ -490,6 +491,101 @@ int minijson_find_property(property_t props[], int count, str name, property_t *
 	return 0;
 }
 
+/*
+Compact property layout (16 bytes instead of ~40 on 64 bit):
+offsets are relative to the document base, key length/datatype/visited are packed in one word.
+*/
+str minijson_compact_key(char *base, property_compact_t *property) {
+	str s;
+	s.s = base + property->key_off;
+	s.len = property->key_len_flags & MINIJSON_COMPACT_KEY_LEN_MASK;
+	return s;
+}
+
+str minijson_compact_val(char *base, property_compact_t *property) {
+	str s;
+	s.s = base + property->val_off;
+	s.len = property->val_len;
+	return s;
+}
+
+int minijson_compact_datatype(property_compact_t *property) {
+	return (property->key_len_flags >> MINIJSON_COMPACT_DATATYPE_SHIFT) & 0xf;
+}
+
+/*
+Same as minijson_parse_object but fills compact properties.
+Offsets are relative to parser->p at the time of the call (the start of the document
+for a freshly initialized parser). Keys longer than MINIJSON_COMPACT_KEY_LEN_MASK are rejected.
+Returns: 0 = error, 1 = success
+*/
+int minijson_parse_object_compact(minijson_object_parser *parser, property_compact_t props[], int *count) {
+	int max_props = *count;
+	char *base = parser->p;
+	property_t property;
+	parsing_func next_step;
+
+	*count = 0;
+
+	while(parser->next_step) {
+		parser->property_collected = 0;
+		next_step = (parsing_func)parser->next_step;
+		parser->next_step = 0;
+		next_step(parser, &property);
+		if(parser->property_collected) {
+			property_compact_t *cprop;
+			(*count)++;
+			if(*count > max_props) {
+				SET_ERROR(parser->error, "minijson_parse_object_compact: no space in array for new key (count=%i)", *count);
+				return 0;
+			}
+			if(property.key.len > MINIJSON_COMPACT_KEY_LEN_MASK) {
+				SET_ERROR(parser->error, "minijson_parse_object_compact: key too long (len=%i)", property.key.len);
+				return 0;
+			}
+			cprop = &props[*count-1];
+			cprop->key_off = property.key.s - base;
+			cprop->val_off = property.val.s - base;
+			cprop->val_len = property.val.len;
+			cprop->key_len_flags = property.key.len | (property.datatype << MINIJSON_COMPACT_DATATYPE_SHIFT);
+		}
+	}
+
+	if(parser->error[0] != 0) {
+		return 0;
+	}
+
+	/* success */
+	return 1;
+}
+
+/* Returns: 1 = got property, 0 = haven't got property */
+int minijson_find_property_compact(char *base, property_compact_t props[], int count, str name, property_compact_t **property) {
+	int i;
+	for(i=0;i<count;++i) {
+		/* one compare checks both the visited flag and the key length */
+		if((props[i].key_len_flags & (MINIJSON_COMPACT_KEY_LEN_MASK | MINIJSON_COMPACT_VISITED)) == (unsigned int)name.len && strncmp(name.s, base + props[i].key_off, name.len) == 0) {
+			props[i].key_len_flags |= MINIJSON_COMPACT_VISITED;
+			*property = &props[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Returns: 1 = got property, 0 = haven't got property */
+int minijson_find_property_compact_ignorecase(char *base, property_compact_t props[], int count, str name, property_compact_t **property) {
+	int i;
+	for(i=0;i<count;++i) {
+		if((props[i].key_len_flags & (MINIJSON_COMPACT_KEY_LEN_MASK | MINIJSON_COMPACT_VISITED)) == (unsigned int)name.len && strncasecmp(name.s, base + props[i].key_off, name.len) == 0) {
+			props[i].key_len_flags |= MINIJSON_COMPACT_VISITED;
+			*property = &props[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
 void minijson_set_error(char *buff, char* format, ...) {
 	va_list args;
 	va_start(args, format);
@@ -497,92 +593,1282 @@ void minijson_set_error(char *buff, char* format, ...) {
 	vsprintf(buff, format, args);
 }
 
-int minijson_set_uchar(char *error_buffer, property_t props[], int count, char *name, unsigned char *p) {
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
+/*
+The set functions work on either property layout: lookup_value finds the
+property (marking it as visited) and the set_*_val helpers do the conversion.
+*/
+static int lookup_value(char *error_buffer, property_t props[], char *base, property_compact_t cprops[], int count, char *name, str *val) {
+	property_t *prop;
+	property_compact_t *cprop;
+
+	if(props) {
+		if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
+			sprintf(error_buffer, "Expected property '%s' not present", name);
+			return 0;
+		}
+		*val = prop->val;
+	} else {
+		if(!minijson_find_property_compact_ignorecase(base, cprops, count, (str)str_init(name), &cprop)) {
+			sprintf(error_buffer, "Expected property '%s' not present", name);
+			return 0;
+		}
+		*val = minijson_compact_val(base, cprop);
+	}
+	return 1;
+}
+
+static int set_byte_array_val(char *error_buffer, char *name, str *val, unsigned char *p) {
+	int i;
+        if(!is_byte_array_string(val)) {
+                sprintf(error_buffer, "Invalid format for property '%s' value (\"%.*s\") : it must be byte array string", name, val->len, val->s);
                 return 0;
         }
 
-        *p = minijson_strntoi(prop->val.s, prop->val.len);
+        for(i=0 ; i < val->len/2 ; ++i) {
+		char *nibble = &val->s[2*i];
+		*p = char2int(*nibble) << 4;
+		*p += char2int(*(++nibble));
+		p++;
+        }
         return 1;
 }
 
-int minijson_set_ushort(char *error_buffer, property_t props[], int count, char *name, unsigned short *p) {
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
-                return 0;
-        }
+int minijson_set_uchar(char *error_buffer, property_t props[], int count, char *name, unsigned char *p) {
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
+        return 1;
+}
 
-        *p = minijson_strntoi(prop->val.s, prop->val.len);
+int minijson_set_ushort(char *error_buffer, property_t props[], int count, char *name, unsigned short *p) {
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
         return 1;
 }
 
 int minijson_set_int(char *error_buffer, property_t props[], int count, char *name, int *p) {
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
-                return 0;
-        }
-
-        *p = minijson_strntoi(prop->val.s, prop->val.len);
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
         return 1;
 }
 
 int minijson_set_float(char *error_buffer, property_t props[], int count, char *name, float *p) {
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
-                return 0;
-        }
-
-        *p = strtod(prop->val.s, NULL); /* the function stops at the first non numeric char */
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+        *p = strtod(val.s, NULL); /* the function stops at the first non numeric char */
 		printf("set_float p=%f\n", *p);
         return 1;
 }
 
 int minijson_set_uchar_array(char *error_buffer, property_t props[], int count, char *name, unsigned char *p) {
-	int i;
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
-                return 0;
-        }
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+	return set_byte_array_val(error_buffer, name, &val, p);
+}
 
-        if(!is_byte_array_string(&prop->val)) {
-                sprintf(error_buffer, "Invalid format for property '%s' value (\"%.*s\") : it must be byte array string", name, prop->val.len, prop->val.s);
-                return 0;
-        }
+int minijson_set_char_array(char *error_buffer, property_t props[], int count, char *name, char *p) {
+	str val;
+	if(!lookup_value(error_buffer, props, 0, 0, count, name, &val)) return 0;
+	return set_byte_array_val(error_buffer, name, &val, (unsigned char*)p);
+}
 
-        for(i=0 ; i < prop->val.len/2 ; ++i) {
-		char *nibble = &prop->val.s[2*i];
-		*p = char2int(*nibble) << 4;
-		*p += char2int(*(++nibble));
-		p++;
-        }
+int minijson_set_uchar_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned char *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
         return 1;
 }
 
-int minijson_set_char_array(char *error_buffer, property_t props[], int count, char *name, char *p) {
-	int i;
-        property_t *prop;
-        if(!minijson_find_property_ignorecase(props, count, (str)str_init(name), &prop)) {
-                sprintf(error_buffer, "Expected property '%s' not present", name);
-                return 0;
-        }
+int minijson_set_ushort_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned short *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
+        return 1;
+}
 
-        if(!is_byte_array_string(&prop->val)) {
-                sprintf(error_buffer, "Invalid format for property '%s' value (\"%.*s\") : it must be byte array string", name, prop->val.len, prop->val.s);
-                return 0;
-        }
+int minijson_set_int_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, int *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+        *p = minijson_strntoi(val.s, val.len);
+        return 1;
+}
 
-        for(i=0 ; i < prop->val.len/2 ; ++i) {
-		char *nibble = &prop->val.s[2*i];
-		*p = char2int(*nibble) << 4;
-		*p += char2int(*(++nibble));
-		p++;
-        }
+int minijson_set_float_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, float *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+        *p = strtod(val.s, NULL); /* the function stops at the first non numeric char */
         return 1;
 }
 
+int minijson_set_uchar_array_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned char *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+	return set_byte_array_val(error_buffer, name, &val, p);
+}
+
+int minijson_set_char_array_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, char *p) {
+	str val;
+	if(!lookup_value(error_buffer, 0, base, props, count, name, &val)) return 0;
+	return set_byte_array_val(error_buffer, name, &val, (unsigned char*)p);
+}
+
+/*
+Structural hashing and equality.
+
+Documents are compared by value: object member order and whitespace don't
+matter, string escapes are decoded (so "A" equals "A") and numbers are
+compared by their double value (so 1, 1.0 and 10e-1 are equal). Object members
+are combined with a commutative sum so the hash doesn't depend on their order.
+Duplicate keys are not supported. Nothing is allocated: minijson_equal_scratch
+takes a caller supplied table to match reordered object members quickly.
+*/
+
+#define STRUCT_MAX_DEPTH 1024
+#define STRUCT_MAX_NUMBER_LEN 64
+
+#define TAG_NULL 0x6e756c6cULL
+#define TAG_TRUE 0x74727565ULL
+#define TAG_FALSE 0x66616c73ULL
+#define TAG_NUMBER 0x6e756d62ULL
+#define TAG_STRING 0x73747269ULL
+#define TAG_ARRAY 0x61727261ULL
+#define TAG_OBJECT 0x6f626a65ULL
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static char *skip_ws(char *p, char *end) {
+	while(p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+	return p;
+}
+
+static int hex4(char *p, char *end, unsigned int *v) {
+	int i;
+	if(end - p < 4) return 0;
+	*v = 0;
+	for(i=0 ; i<4 ; ++i) {
+		if(!isxdigit((unsigned char)p[i])) return 0;
+		*v = (*v << 4) | char2int(p[i]);
+	}
+	return 1;
+}
+
+/*
+Decodes the escape sequence at p (pointing at the backslash) into utf-8 bytes.
+Returns: number of bytes written to out (1 to 4) or 0 if malformed. *pp is moved past the sequence.
+*/
+static int decode_escape(char **pp, char *end, unsigned char out[4]) {
+	char *p = *pp + 1;
+	unsigned int cp, lo;
+
+	if(p == end) return 0;
+	switch(*p) {
+	case '"': case '\\': case '/': out[0] = *p; *pp = p + 1; return 1;
+	case 'b': out[0] = '\b'; *pp = p + 1; return 1;
+	case 'f': out[0] = '\f'; *pp = p + 1; return 1;
+	case 'n': out[0] = '\n'; *pp = p + 1; return 1;
+	case 'r': out[0] = '\r'; *pp = p + 1; return 1;
+	case 't': out[0] = '\t'; *pp = p + 1; return 1;
+	case 'u': break;
+	default: return 0;
+	}
+
+	if(!hex4(p + 1, end, &cp)) return 0;
+	p += 5;
+	if(cp >= 0xd800 && cp <= 0xdbff && end - p >= 6 && p[0] == '\\' && p[1] == 'u' && hex4(p + 2, end, &lo) && lo >= 0xdc00 && lo <= 0xdfff) {
+		cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+		p += 6;
+	}
+	*pp = p;
+
+	if(cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	} else if(cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	} else if(cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	out[0] = 0xf0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3f);
+	out[2] = 0x80 | ((cp >> 6) & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/* reads the decoded bytes of a string one at a time (used to compare strings without a copy) */
+typedef struct {
+	char *p; // after the opening quote
+	char *end;
+	unsigned char buf[4];
+	int buf_len;
+	int buf_pos;
+} string_reader;
+
+/* Returns: next byte, -1 = end of string (reader moved past closing quote), -2 = malformed */
+static int string_reader_next(string_reader *r) {
+	if(r->buf_pos < r->buf_len) return r->buf[r->buf_pos++];
+	if(r->p == r->end) return -2;
+	if(*r->p == '"') {
+		++r->p;
+		return -1;
+	}
+	if(*r->p != '\\') return (unsigned char)*r->p++;
+	r->buf_len = decode_escape(&r->p, r->end, r->buf);
+	if(r->buf_len == 0) return -2;
+	r->buf_pos = 1;
+	return r->buf[0];
+}
+
+/* p: after the opening quote. Returns: pointer after the closing quote or NULL if malformed */
+static char *hash_string(char *p, char *end, unsigned long long *hash) {
+	unsigned long long h = FNV_OFFSET;
+	unsigned char buf[4];
+	int i, n;
+
+	while(p != end) {
+		if(*p == '"') {
+			*hash = minijson_mix64(h ^ TAG_STRING);
+			return p + 1;
+		}
+		if(*p != '\\') {
+			h = (h ^ (unsigned char)*p++) * FNV_PRIME;
+			continue;
+		}
+		n = decode_escape(&p, end, buf);
+		if(n == 0) return 0;
+		for(i=0 ; i<n ; ++i) h = (h ^ buf[i]) * FNV_PRIME;
+	}
+	return 0;
+}
+
+/* Returns: pointer after the number or NULL if p doesn't hold a valid json number */
+static char *scan_number(char *p, char *end) {
+	if(p != end && *p == '-') ++p;
+	if(p == end || !isdigit((unsigned char)*p)) return 0;
+	if(*p == '0') {
+		++p;
+	} else {
+		while(p != end && isdigit((unsigned char)*p)) ++p;
+	}
+	if(p != end && *p == '.') {
+		++p;
+		if(p == end || !isdigit((unsigned char)*p)) return 0;
+		while(p != end && isdigit((unsigned char)*p)) ++p;
+	}
+	if(p != end && (*p == 'e' || *p == 'E')) {
+		++p;
+		if(p != end && (*p == '+' || *p == '-')) ++p;
+		if(p == end || !isdigit((unsigned char)*p)) return 0;
+		while(p != end && isdigit((unsigned char)*p)) ++p;
+	}
+	return p;
+}
+
+/* Returns: 1 = converted, 0 = too long to normalize (compare as text instead) */
+static int number_value(char *s, int len, double *d) {
+	char buf[STRUCT_MAX_NUMBER_LEN];
+	if(len >= STRUCT_MAX_NUMBER_LEN) return 0;
+	memcpy(buf, s, len); /* the number may not be followed by a delimiter strtod can stop at */
+	buf[len] = 0;
+	*d = strtod(buf, NULL);
+	if(*d == 0) *d = 0; /* -0 == 0 */
+	return 1;
+}
+
+static int literal(char *p, char *end, char *lit, int len) {
+	return end - p >= len && memcmp(p, lit, len) == 0;
+}
+
+/* Returns: pointer after the value or NULL if malformed */
+static char *hash_value(char *p, char *end, int depth, unsigned long long *hash) {
+	unsigned long long h, acc;
+	unsigned long long count = 0;
+	char *q;
+	double d;
+
+	if(depth > STRUCT_MAX_DEPTH) return 0;
+	p = skip_ws(p, end);
+	if(p == end) return 0;
+
+	switch(*p) {
+	case '"':
+		return hash_string(p + 1, end, hash);
+
+	case '{':
+		acc = 0;
+		p = skip_ws(p + 1, end);
+		if(p != end && *p == '}') {
+			*hash = minijson_mix64(TAG_OBJECT);
+			return p + 1;
+		}
+		while(1) {
+			unsigned long long key_h, val_h;
+			if(p == end || *p != '"') return 0;
+			p = hash_string(p + 1, end, &key_h);
+			if(!p) return 0;
+			p = skip_ws(p, end);
+			if(p == end || *p != ':') return 0;
+			p = hash_value(p + 1, end, depth + 1, &val_h);
+			if(!p) return 0;
+			acc += minijson_mix64(key_h ^ minijson_mix64(val_h + 0x9e3779b97f4a7c15ULL)); /* commutative: member order doesn't matter */
+			count++;
+			p = skip_ws(p, end);
+			if(p == end) return 0;
+			if(*p == '}') break;
+			if(*p != ',') return 0;
+			p = skip_ws(p + 1, end);
+		}
+		*hash = minijson_mix64(acc ^ minijson_mix64(count ^ TAG_OBJECT));
+		return p + 1;
+
+	case '[':
+		h = minijson_mix64(TAG_ARRAY);
+		p = skip_ws(p + 1, end);
+		if(p != end && *p == ']') {
+			*hash = h;
+			return p + 1;
+		}
+		while(1) {
+			unsigned long long elem_h;
+			p = hash_value(p, end, depth + 1, &elem_h);
+			if(!p) return 0;
+			h = minijson_mix64(h + elem_h); /* ordered */
+			p = skip_ws(p, end);
+			if(p == end) return 0;
+			if(*p == ']') break;
+			if(*p != ',') return 0;
+			++p;
+		}
+		*hash = h;
+		return p + 1;
+
+	case 't':
+		if(!literal(p, end, "true", 4)) return 0;
+		*hash = minijson_mix64(TAG_TRUE);
+		return p + 4;
+
+	case 'f':
+		if(!literal(p, end, "false", 5)) return 0;
+		*hash = minijson_mix64(TAG_FALSE);
+		return p + 5;
+
+	case 'n':
+		if(!literal(p, end, "null", 4)) return 0;
+		*hash = minijson_mix64(TAG_NULL);
+		return p + 4;
+	}
+
+	q = scan_number(p, end);
+	if(!q) return 0;
+	if(number_value(p, q - p, &d)) {
+		memcpy(&h, &d, sizeof(h));
+	} else {
+		h = FNV_OFFSET;
+		while(p != q) h = (h ^ (unsigned char)*p++) * FNV_PRIME;
+	}
+	*hash = minijson_mix64(h ^ TAG_NUMBER);
+	return q;
+}
+
+/* Returns: pointer after the value or NULL if malformed */
+static char *skip_value(char *p, char *end, int depth) {
+	unsigned long long h;
+	return hash_value(p, end, depth, &h);
+}
+
+/* Returns: pointer after the closing quote of b if both strings decode to the same bytes, NULL otherwise */
+static char *equal_string(char **pa, char *ea, char *pb, char *eb) {
+	string_reader ra, rb;
+	int ca, cb;
+
+	ra.p = *pa; ra.end = ea; ra.buf_len = ra.buf_pos = 0;
+	rb.p = pb; rb.end = eb; rb.buf_len = rb.buf_pos = 0;
+	do {
+		ca = string_reader_next(&ra);
+		cb = string_reader_next(&rb);
+		if(ca != cb || ca == -2) return 0;
+	} while(ca != -1);
+	*pa = ra.p;
+	return rb.p;
+}
+
+static void member_hash_sift_down(minijson_member_hash table[], int root, int count) {
+	minijson_member_hash tmp;
+	int child;
+
+	while((child = 2 * root + 1) < count) {
+		if(child + 1 < count && table[child + 1].key_hash > table[child].key_hash) ++child;
+		if(table[root].key_hash >= table[child].key_hash) return;
+		tmp = table[root];
+		table[root] = table[child];
+		table[child] = tmp;
+		root = child;
+	}
+}
+
+/* heapsort by key_hash: in place (qsort may allocate a temporary buffer) */
+static void member_hash_sort(minijson_member_hash table[], int count) {
+	minijson_member_hash tmp;
+	int i;
+
+	for(i=count/2 - 1 ; i>=0 ; --i) member_hash_sift_down(table, i, count);
+	for(i=count - 1 ; i>0 ; --i) {
+		tmp = table[0];
+		table[0] = table[i];
+		table[i] = tmp;
+		member_hash_sift_down(table, 0, i);
+	}
+}
+
+/* Skips a value already validated by hash_value. Returns: pointer after the value */
+static char *skip_valid_value(char *p, char *end) {
+	int depth = 0;
+
+	p = skip_ws(p, end);
+	do {
+		if(*p == '"') {
+			for(++p ; *p != '"' ; ++p) {
+				if(*p == '\\') ++p;
+			}
+		} else if(*p == '{' || *p == '[') {
+			depth++;
+		} else if(*p == '}' || *p == ']') {
+			depth--;
+		} else if(depth == 0) {
+			/* number or literal at the top */
+			while(p != end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') ++p;
+			return p;
+		}
+		++p;
+	} while(depth > 0);
+	return p;
+}
+
+/*
+Looks for the key at *pa (after its opening quote) among the members of an object in b,
+starting at the member at start and wrapping around to first (both point at a key).
+Returns: pointer after the closing quote of the matching key in b or NULL if not found. *pa is moved past the key.
+*/
+static char *find_member(char **pa, char *ea, char *start, char *first, char *eb) {
+	char *m = start;
+	char *after_key;
+
+	do {
+		after_key = equal_string(pa, ea, m + 1, eb);
+		if(after_key) return after_key;
+		m = skip_valid_value(m, eb); /* b was validated while counting its members */
+		m = skip_ws(m, eb);
+		m = skip_valid_value(m + 1, eb);
+		m = skip_ws(m, eb);
+		m = (*m == ',') ? skip_ws(m + 1, eb) : first;
+	} while(m != start);
+	return 0;
+}
+
+/* Same as find_member but using the key hashes of b's members (sorted on first use) */
+static char *lookup_member(char **pa, char *ea, minijson_member_hash table[], int count, int *sorted, char *eb) {
+	unsigned long long key_h;
+	int lo = 0, hi = count, mid;
+	char *after_key;
+
+	if(!hash_string(*pa, ea, &key_h)) return 0;
+	if(!*sorted) {
+		member_hash_sort(table, count);
+		*sorted = 1;
+	}
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(table[mid].key_hash < key_h) lo = mid + 1;
+		else hi = mid;
+	}
+	for( ; lo < count && table[lo].key_hash == key_h ; ++lo) {
+		after_key = equal_string(pa, ea, table[lo].member + 1, eb);
+		if(after_key) return after_key;
+	}
+	return 0;
+}
+
+/*
+Compares the values at *pa and *pb, moving both past their value.
+scratch: optional (may be NULL) room for the member hashes of b's objects, used when members are not in the same order.
+Returns: 1 = equal, 0 = different or malformed
+*/
+static int equal_value(char **pa, char *ea, char **pb, char *eb, int depth, minijson_member_hash *scratch, int scratch_count) {
+	char *a, *b, *q;
+	double da, db;
+	int count_a, count_b;
+
+	if(depth > STRUCT_MAX_DEPTH) return 0;
+	a = skip_ws(*pa, ea);
+	b = skip_ws(*pb, eb);
+	if(a == ea || b == eb || *a != *b) {
+		/* numbers can start with '-' or a digit: let the number branch decide */
+		if(a == ea || b == eb || !((*a == '-' || isdigit((unsigned char)*a)) && (*b == '-' || isdigit((unsigned char)*b)))) return 0;
+	}
+
+	switch(*a) {
+	case '"':
+		++a;
+		b = equal_string(&a, ea, b + 1, eb);
+		if(!b) return 0;
+		break;
+
+	case '{': {
+		/*
+		count (and validate) the members of b, keeping their key hashes if they fit in scratch.
+		Then every member of a is looked up in b starting after the previous match, so
+		documents with the same member order are compared in one pass.
+		*/
+		minijson_member_hash *table = 0;
+		char *first, *next, *m, *ka;
+		int sorted = 0;
+
+		count_b = 0;
+		first = q = skip_ws(b + 1, eb);
+		if(q == eb) return 0;
+		if(*q != '}') {
+			while(1) {
+				unsigned long long key_h;
+				if(q == eb || *q != '"') return 0;
+				m = q;
+				q = hash_string(q + 1, eb, &key_h);
+				if(!q) return 0;
+				q = skip_ws(q, eb);
+				if(q == eb || *q != ':') return 0;
+				q = skip_value(q + 1, eb, depth + 1);
+				if(!q) return 0;
+				if(count_b < scratch_count) {
+					scratch[count_b].key_hash = key_h;
+					scratch[count_b].member = m;
+				}
+				count_b++;
+				q = skip_ws(q, eb);
+				if(q == eb) return 0;
+				if(*q == '}') break;
+				if(*q != ',') return 0;
+				q = skip_ws(q + 1, eb);
+			}
+		}
+		if(count_b <= scratch_count) {
+			/* complete: nested objects use the rest of scratch */
+			table = scratch;
+			scratch += count_b;
+			scratch_count -= count_b;
+		}
+
+		count_a = 0;
+		next = first;
+		a = skip_ws(a + 1, ea);
+		if(a != ea && *a != '}') {
+			while(1) {
+				if(a == ea || *a != '"' || *next != '"') return 0;
+				ka = a + 1;
+				m = equal_string(&ka, ea, next + 1, eb); /* same order: it is the next member */
+				if(!m && table) m = lookup_member(&ka, ea, table, count_b, &sorted, eb);
+				else if(!m) m = find_member(&ka, ea, next, first, eb);
+				if(!m) return 0;
+
+				a = skip_ws(ka, ea);
+				m = skip_ws(m, eb);
+				if(a == ea || *a != ':' || *m != ':') return 0;
+				++a;
+				++m;
+				if(!equal_value(&a, ea, &m, eb, depth + 1, scratch, scratch_count)) return 0;
+				m = skip_ws(m, eb);
+				next = (*m == ',') ? skip_ws(m + 1, eb) : first;
+
+				count_a++;
+				a = skip_ws(a, ea);
+				if(a == ea) return 0;
+				if(*a == '}') break;
+				if(*a != ',') return 0;
+				a = skip_ws(a + 1, ea);
+			}
+		}
+		if(count_a != count_b) return 0;
+		a++;
+		b = q + 1;
+		break;
+	}
+
+	case '[':
+		a = skip_ws(a + 1, ea);
+		b = skip_ws(b + 1, eb);
+		if(a != ea && *a == ']') {
+			if(b == eb || *b != ']') return 0;
+		} else {
+			while(1) {
+				if(!equal_value(&a, ea, &b, eb, depth + 1, scratch, scratch_count)) return 0;
+				a = skip_ws(a, ea);
+				b = skip_ws(b, eb);
+				if(a == ea || b == eb || *a != *b) return 0;
+				if(*a == ']') break;
+				if(*a != ',') return 0;
+				++a;
+				++b;
+			}
+		}
+		a++;
+		b++;
+		break;
+
+	case 't':
+	case 'f':
+	case 'n':
+		q = skip_value(a, ea, depth);
+		if(!q || q - a > eb - b || memcmp(a, b, q - a) != 0) return 0;
+		b += q - a;
+		a = q;
+		break;
+
+	default:
+		q = scan_number(a, ea);
+		if(!q) return 0;
+		*pb = scan_number(b, eb);
+		if(!*pb) return 0;
+		if(number_value(a, q - a, &da) && number_value(b, *pb - b, &db)) {
+			if(da != db) return 0;
+		} else if(q - a != *pb - b || memcmp(a, b, q - a) != 0) {
+			return 0;
+		}
+		b = *pb;
+		a = q;
+		break;
+	}
+
+	*pa = a;
+	*pb = b;
+	return 1;
+}
+
+/*
+Order and whitespace independent hash of a json document.
+Returns: 1 = success, 0 = malformed document
+*/
+int minijson_hash(str *s, unsigned long long *hash) {
+	char *end = s->s + s->len;
+	char *p = hash_value(s->s, end, 0, hash);
+	if(!p) return 0;
+	return skip_ws(p, end) == end;
+}
+
+/* Returns: 1 = documents are structurally equal, 0 = different or malformed */
+int minijson_equal(str *a, str *b) {
+	return minijson_equal_scratch(a, b, 0, 0);
+}
+
+/*
+Same as minijson_equal. scratch holds the key hashes of b's objects so that members
+in a different order are found by binary search instead of a scan of the object.
+It needs one entry per member of each object on the current path (nested objects
+use what is left). Objects that don't fit are scanned.
+Returns: 1 = documents are structurally equal, 0 = different or malformed
+*/
+int minijson_equal_scratch(str *a, str *b, minijson_member_hash scratch[], int scratch_count) {
+	unsigned long long ha, hb;
+	char *pa = a->s;
+	char *pb = b->s;
+
+	if(!minijson_hash(a, &ha) || !minijson_hash(b, &hb) || ha != hb) return 0;
+	if(!equal_value(&pa, a->s + a->len, &pb, b->s + b->len, 0, scratch, scratch_count)) return 0;
+	return 1;
+}
+
+/*
+Chunked parser interface.
+
+Parses an object fed in pieces (ex: as it arrives from a socket) with bounded
+memory. Keys and values are collected in a buffer of buf_size bytes and returned
+as MINIJSON_EVENT_PROPERTY. A string value that grows beyond threshold bytes is
+not buffered: it is delivered as VALUE_BEGIN, any number of VALUE_CHUNK (raw
+bytes, escapes not decoded, optionally passed through a decoder such as
+minijson_decode_hex) and VALUE_END. Other values (numbers, nested objects and
+arrays) must fit in the buffer.
+
+Event data points into the parser buffer or into the data given to
+minijson_chunked_feed, and is valid until the next call to minijson_chunked_next.
+*/
+
+#define CS_OPEN 0
+#define CS_KEY_OR_END 1
+#define CS_KEY_START 2
+#define CS_KEY 3
+#define CS_COLON 4
+#define CS_VALUE 5
+#define CS_STRING 6
+#define CS_STREAM_BEGIN 7
+#define CS_STREAM_BUFFERED 8
+#define CS_STREAM 9
+#define CS_BARE 10
+#define CS_NESTED 11
+#define CS_COMMA_OR_END 12
+#define CS_DONE 13
+
+#define IS_WS(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+/* Returns: 1 = success, 0 = invalid arguments or out of memory */
+int minijson_chunked_parser_init(minijson_chunked_parser *parser, int buf_size, int threshold) {
+	memset(parser, 0, sizeof(minijson_chunked_parser));
+	if(buf_size <= 0 || threshold <= 0 || threshold >= buf_size) {
+		SET_ERROR(parser->error, "minijson_chunked_parser_init: threshold (%i) must be smaller than buf_size", threshold);
+		return 0;
+	}
+	/* second half holds decoder output */
+	parser->buf = malloc(buf_size * 2);
+	if(!parser->buf) {
+		SET_ERROR(parser->error, "minijson_chunked_parser_init: failed to allocate %i bytes", buf_size * 2);
+		return 0;
+	}
+	parser->buf_size = buf_size;
+	parser->threshold = threshold;
+	parser->state = CS_OPEN;
+	return 1;
+}
+
+void minijson_chunked_parser_free(minijson_chunked_parser *parser) {
+	free(parser->buf);
+	parser->buf = 0;
+}
+
+void minijson_chunked_parser_set_decoder(minijson_chunked_parser *parser, minijson_chunk_decoder decoder) {
+	parser->decoder = decoder;
+	parser->decoder_state = -1;
+}
+
+/* Hands the next piece of input to the parser. The previous piece must have been consumed (minijson_chunked_next returned 0). */
+void minijson_chunked_feed(minijson_chunked_parser *parser, char *data, int len) {
+	parser->in = data;
+	parser->in_end = data + len;
+}
+
+/*
+Decoder for hex payloads: "0a0B.." => bytes. An odd nibble at the end of a chunk is carried to the next one.
+Returns: number of bytes written, -1 = non hex char
+*/
+int minijson_decode_hex(minijson_chunked_parser *parser, char *in, int len, char *out) {
+	int n = 0;
+	int i;
+	for(i=0 ; i<len ; ++i) {
+		if(!isxdigit((unsigned char)in[i])) return -1;
+		if(parser->decoder_state < 0) {
+			parser->decoder_state = char2int(in[i]);
+		} else {
+			out[n++] = (parser->decoder_state << 4) | char2int(in[i]);
+			parser->decoder_state = -1;
+		}
+	}
+	return n;
+}
+
+static void chunked_set_key(minijson_chunked_parser *parser, minijson_event *event, int type) {
+	event->type = type;
+	event->property.key.s = parser->buf;
+	event->property.key.len = parser->key_len;
+	event->property.val.s = 0;
+	event->property.val.len = 0;
+	event->property.datatype = JSON_DATATYPE_STRING;
+	event->property.visited = 0;
+}
+
+/* Returns: 1 = success, 0 = the decoder rejected the chunk */
+static int chunked_set_chunk(minijson_chunked_parser *parser, minijson_event *event, char *data, int len) {
+	chunked_set_key(parser, event, MINIJSON_EVENT_VALUE_CHUNK);
+	if(parser->decoder) {
+		char *out = parser->buf + parser->buf_size;
+		len = parser->decoder(parser, data, len, out);
+		if(len < 0) {
+			SET_ERROR(parser->error, "minijson_chunked_next: invalid data for decoder in value of '%.*s'", parser->key_len, parser->buf);
+			return 0;
+		}
+		data = out;
+	}
+	event->property.val.s = data;
+	event->property.val.len = len;
+	return 1;
+}
+
+static int chunked_collect(minijson_chunked_parser *parser, char c) {
+	if(parser->key_len + parser->val_len == parser->buf_size) {
+		SET_ERROR(parser->error, "minijson_chunked_next: value of '%.*s' larger than buffer (%i bytes)", parser->key_len, parser->buf, parser->buf_size);
+		return 0;
+	}
+	parser->buf[parser->key_len + parser->val_len++] = c;
+	return 1;
+}
+
+/* Returns: 1 = got event, 0 = haven't got event (more data needed, parsing finished or error: check parser->error) */
+int minijson_chunked_next(minijson_chunked_parser *parser, minijson_event *event) {
+	char *p = parser->in;
+	char *end = parser->in_end;
+	char c;
+
+	if(parser->error[0] != 0) {
+		return 0;
+	}
+
+	while(1) {
+		switch(parser->state) {
+		case CS_STREAM_BEGIN:
+			chunked_set_key(parser, event, MINIJSON_EVENT_VALUE_BEGIN);
+			parser->state = CS_STREAM_BUFFERED;
+			parser->in = p;
+			return 1;
+
+		case CS_STREAM_BUFFERED:
+			if(!chunked_set_chunk(parser, event, parser->buf + parser->key_len, parser->val_len)) return 0;
+			parser->state = CS_STREAM;
+			parser->in = p;
+			return 1;
+
+		case CS_STREAM: {
+			/* deliver straight from the input, up to the closing quote */
+			char *start = p;
+			char *limit = end - p > parser->buf_size ? p + parser->buf_size : end;
+			while(p != limit) {
+				if(parser->escaped) {
+					parser->escaped = 0;
+				} else if(*p == '\\') {
+					parser->escaped = 1;
+				} else if(*p == '"') {
+					break;
+				}
+				++p;
+			}
+			if(p != start) {
+				parser->in = p;
+				return chunked_set_chunk(parser, event, start, p - start);
+			}
+			if(p == end) {
+				parser->in = p;
+				return 0;
+			}
+			/* closing quote */
+			if(parser->decoder && parser->decoder_state >= 0) {
+				SET_ERROR(parser->error, "minijson_chunked_next: value of '%.*s' ends in the middle of a decoded unit (ex: odd number of hex digits)", parser->key_len, parser->buf);
+				return 0;
+			}
+			++p;
+			chunked_set_key(parser, event, MINIJSON_EVENT_VALUE_END);
+			parser->state = CS_COMMA_OR_END;
+			parser->in = p;
+			return 1;
+		}
+		}
+
+		if(p == end) {
+			parser->in = p;
+			return 0;
+		}
+		c = *p;
+
+		switch(parser->state) {
+		case CS_OPEN:
+			if(IS_WS(c)) break;
+			if(c != '{') {
+				SET_ERROR(parser->error, "minijson_chunked_next: unexpected char '%c' while searching for '{'", c);
+				return 0;
+			}
+			parser->state = CS_KEY_OR_END;
+			break;
+
+		case CS_KEY_OR_END:
+		case CS_KEY_START:
+			if(IS_WS(c)) break;
+			if(c == '}' && parser->state == CS_KEY_OR_END) {
+				parser->state = CS_DONE;
+				event->type = MINIJSON_EVENT_END;
+				parser->in = p + 1;
+				return 1;
+			}
+			if(c != '"') {
+				SET_ERROR(parser->error, "minijson_chunked_next: unexpected char '%c' while searching for opening '\"'", c);
+				return 0;
+			}
+			parser->key_len = 0;
+			parser->val_len = 0;
+			parser->escaped = 0;
+			parser->state = CS_KEY;
+			break;
+
+		case CS_KEY:
+			if(!parser->escaped && c == '"') {
+				if(parser->key_len == 0) {
+					SET_ERROR(parser->error, "minijson_chunked_next: invalid zero-length key%s", "");
+					return 0;
+				}
+				parser->state = CS_COLON;
+				break;
+			}
+			parser->escaped = !parser->escaped && c == '\\';
+			if(parser->key_len + parser->threshold >= parser->buf_size) {
+				SET_ERROR(parser->error, "minijson_chunked_next: key too long (buf_size=%i)", parser->buf_size);
+				return 0;
+			}
+			parser->buf[parser->key_len++] = c;
+			break;
+
+		case CS_COLON:
+			if(IS_WS(c)) break;
+			if(c != ':') {
+				SET_ERROR(parser->error, "minijson_chunked_next: unexpected char '%c' while searching for ':'", c);
+				return 0;
+			}
+			parser->state = CS_VALUE;
+			break;
+
+		case CS_VALUE:
+			if(IS_WS(c)) break;
+			if(c == '"') {
+				parser->escaped = 0;
+				parser->state = CS_STRING;
+				break;
+			}
+			if(c == '{' || c == '[') {
+				parser->depth = 0;
+				parser->stack[0] = c == '{' ? '}' : ']';
+				parser->nested_in_string = 0;
+				parser->escaped = 0;
+				parser->state = CS_NESTED;
+				if(!chunked_collect(parser, c)) return 0;
+				break;
+			}
+			if(c == '}' || c == ']' || c == ',') {
+				SET_ERROR(parser->error, "minijson_chunked_next: unexpected '%c' while waiting for start of value", c);
+				return 0;
+			}
+			parser->state = CS_BARE;
+			if(!chunked_collect(parser, c)) return 0;
+			break;
+
+		case CS_STRING:
+			if(!parser->escaped && c == '"') {
+				event->type = MINIJSON_EVENT_PROPERTY;
+				event->property.key.s = parser->buf;
+				event->property.key.len = parser->key_len;
+				event->property.val.s = parser->buf + parser->key_len;
+				event->property.val.len = parser->val_len;
+				event->property.datatype = JSON_DATATYPE_STRING;
+				event->property.visited = 0;
+				parser->state = CS_COMMA_OR_END;
+				parser->in = p + 1;
+				return 1;
+			}
+			parser->escaped = !parser->escaped && c == '\\';
+			parser->buf[parser->key_len + parser->val_len++] = c;
+			if(parser->val_len >= parser->threshold) {
+				/* too big to buffer: switch to chunked delivery */
+				parser->state = CS_STREAM_BEGIN;
+				parser->decoder_state = -1;
+			}
+			break;
+
+		case CS_BARE:
+			if(IS_WS(c) || c == ',' || c == '}') {
+				str val;
+				val.s = parser->buf + parser->key_len;
+				val.len = parser->val_len;
+				event->property.datatype = json_get_datatype(&val);
+				if(event->property.datatype == JSON_DATATYPE_INVALID) {
+					SET_ERROR(parser->error, "minijson_chunked_next: invalid string for number/constant %.*s", val.len, val.s);
+					return 0;
+				}
+				event->type = MINIJSON_EVENT_PROPERTY;
+				event->property.key.s = parser->buf;
+				event->property.key.len = parser->key_len;
+				event->property.val = val;
+				event->property.visited = 0;
+				parser->state = CS_COMMA_OR_END;
+				parser->in = p; /* terminator is handled by CS_COMMA_OR_END */
+				return 1;
+			}
+			if(!chunked_collect(parser, c)) return 0;
+			break;
+
+		case CS_NESTED:
+			if(!chunked_collect(parser, c)) return 0;
+			if(parser->nested_in_string) {
+				if(parser->escaped) parser->escaped = 0;
+				else if(c == '\\') parser->escaped = 1;
+				else if(c == '"') parser->nested_in_string = 0;
+				break;
+			}
+			if(c == '"') {
+				parser->nested_in_string = 1;
+			} else if(c == '{' || c == '[') {
+				if(parser->depth + 1 == (int)sizeof(parser->stack)) {
+					SET_ERROR(parser->error, "minijson_chunked_next: value of '%.*s' nested too deep", parser->key_len, parser->buf);
+					return 0;
+				}
+				parser->stack[++parser->depth] = c == '{' ? '}' : ']';
+			} else if(c == '}' || c == ']') {
+				if(c != parser->stack[parser->depth]) {
+					SET_ERROR(parser->error, "minijson_chunked_next: malformed value for %.*s", parser->key_len, parser->buf);
+					return 0;
+				}
+				if(parser->depth == 0) {
+					event->type = MINIJSON_EVENT_PROPERTY;
+					event->property.key.s = parser->buf;
+					event->property.key.len = parser->key_len;
+					event->property.val.s = parser->buf + parser->key_len;
+					event->property.val.len = parser->val_len;
+					event->property.datatype = c == '}' ? JSON_DATATYPE_OBJECT : JSON_DATATYPE_ARRAY;
+					event->property.visited = 0;
+					parser->state = CS_COMMA_OR_END;
+					parser->in = p + 1;
+					return 1;
+				}
+				parser->depth--;
+			}
+			break;
+
+		case CS_COMMA_OR_END:
+			if(IS_WS(c)) break;
+			if(c == ',') {
+				parser->state = CS_KEY_START;
+				break;
+			}
+			if(c == '}') {
+				parser->state = CS_DONE;
+				event->type = MINIJSON_EVENT_END;
+				parser->in = p + 1;
+				return 1;
+			}
+			SET_ERROR(parser->error, "minijson_chunked_next: unexpected '%c' while waiting for ','", c);
+			return 0;
+
+		case CS_DONE:
+			if(IS_WS(c)) break;
+			SET_ERROR(parser->error, "minijson_chunked_next: garbage '%c' after closing bracket", c);
+			return 0;
+		}
+		++p;
+	}
+}
+
+/*
+Bulk decoding of numeric arrays ("[12, 15, -3, ...]") into typed buffers.
+
+Digits are converted 8 at a time: 8 bytes are loaded in a 64 bit word, the run
+of leading digits is found with a bit trick and converted with 3 multiplications
+(SWAR, SIMD within a register). Shorter runs are left padded with '0' so the
+same kernel handles numbers of any length. Big endian machines and the last
+bytes of the buffer use a plain digit loop.
+*/
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && defined(__GNUC__) && __GNUC__ >= 4
+#define SWAR_DIGITS 1
+#endif
+
+#ifdef SWAR_DIGITS
+/* converts 8 ascii digits (first digit in the lowest byte) */
+static unsigned int swar_parse_8(unsigned long long v) {
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+	     (((v >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+	return (unsigned int)v;
+}
+#endif
+
+/*
+Converts the run of digits at p.
+Returns: number of digits consumed (0 if p doesn't start with a digit). *value wraps beyond 19 digits.
+*/
+static int parse_digits(char *p, char *end, unsigned long long *value) {
+	unsigned long long v = 0;
+	char *start = p;
+
+#ifdef SWAR_DIGITS
+	static const unsigned long long pow10[8] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+	while(end - p >= 8) {
+		unsigned long long w, nondigit;
+		int n;
+		memcpy(&w, p, 8);
+		/* high bit set in every byte that is not '0'..'9' (exact up to the first such byte) */
+		nondigit = ((w + 0x4646464646464646ULL) | (w - 0x3030303030303030ULL)) & 0x8080808080808080ULL;
+		if(nondigit == 0) {
+			v = v * 100000000ULL + swar_parse_8(w);
+			p += 8;
+			continue;
+		}
+		n = __builtin_ctzll(nondigit) >> 3;
+		if(n > 0) {
+			/* move the n digits to the high bytes and pad the low ones with '0' */
+			w = (w << (8 * (8 - n))) | (0x3030303030303030ULL >> (8 * n));
+			v = v * pow10[n] + swar_parse_8(w);
+			p += n;
+		}
+		*value = v;
+		return p - start;
+	}
+#endif
+	while(p != end && *p >= '0' && *p <= '9') {
+		v = v * 10 + (*p - '0');
+		++p;
+	}
+	*value = v;
+	return p - start;
+}
+
+static const double exact_pow10[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Returns: pointer after the number or NULL if it is not a valid json integer that fits in an int */
+static char *decode_int(char *p, char *end, int *out) {
+	unsigned long long v;
+	int neg = 0;
+	int n;
+
+	if(p != end && *p == '-') {
+		neg = 1;
+		++p;
+	}
+	n = parse_digits(p, end, &v);
+	if(n == 0 || (n > 1 && *p == '0') || n > 10) return 0;
+	if(v > (neg ? 2147483648ULL : 2147483647ULL)) return 0;
+	p += n;
+	if(p != end && (*p == '.' || *p == 'e' || *p == 'E')) return 0;
+	*out = neg ? (int)(0 - v) : (int)v;
+	return p;
+}
+
+/* Returns: pointer after the number or NULL if it is not a valid json number */
+static char *decode_double(char *p, char *end, double *out) {
+	char *start = p;
+	unsigned long long mantissa, frac;
+	int exp10 = 0;
+	int exp_value = 0;
+	int exact = 1;
+	int neg = 0;
+	int n, k;
+	double d;
+
+	if(p != end && *p == '-') {
+		neg = 1;
+		++p;
+	}
+	n = parse_digits(p, end, &mantissa);
+	if(n == 0 || (n > 1 && *p == '0')) return 0;
+	if(n > 19) exact = 0;
+	p += n;
+
+	if(p != end && *p == '.') {
+		++p;
+		k = parse_digits(p, end, &frac);
+		if(k == 0) return 0;
+		if(n + k > 19) {
+			exact = 0;
+		} else {
+			int i;
+			for(i=0 ; i<k ; ++i) mantissa *= 10;
+			mantissa += frac;
+			exp10 = -k;
+		}
+		p += k;
+	}
+
+	if(p != end && (*p == 'e' || *p == 'E')) {
+		int exp_neg = 0;
+		unsigned long long e;
+		++p;
+		if(p != end && (*p == '+' || *p == '-')) {
+			exp_neg = *p == '-';
+			++p;
+		}
+		k = parse_digits(p, end, &e);
+		if(k == 0) return 0;
+		if(k > 4) exact = 0;
+		else exp_value = exp_neg ? -(int)e : (int)e;
+		p += k;
+	}
+	exp10 += exp_value;
+
+	/* mantissa and power of ten both exact as doubles: one correctly rounded operation */
+	if(exact && mantissa <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+		d = (double)mantissa;
+		if(exp10 < 0) d /= exact_pow10[-exp10];
+		else d *= exact_pow10[exp10];
+		*out = neg ? -d : d;
+		return p;
+	}
+
+	/* p is inside the buffer and not part of the number, so strtod stops there */
+	if(p == end) return 0;
+	d = strtod(start, NULL);
+	*out = d;
+	return p;
+}
+
+/* Returns: 0 = error, 1 = success */
+static int decode_number_array(str *s, int is_double, void *out, int capacity, int *count, int *bad_index) {
+	char *p = s->s;
+	char *end = s->s + s->len;
+	char *q;
+	int idx = 0;
+
+	*count = 0;
+	*bad_index = -1;
+
+	p = skip_ws(p, end);
+	if(p == end || *p != '[') return 0;
+	p = skip_ws(p + 1, end);
+	if(p != end && *p == ']') {
+		return skip_ws(p + 1, end) == end;
+	}
+
+	while(1) {
+		if(idx == capacity) {
+			*bad_index = idx;
+			return 0;
+		}
+		if(is_double) {
+			q = decode_double(p, end, (double*)out + idx);
+		} else {
+			q = decode_int(p, end, (int*)out + idx);
+		}
+		if(!q || q == end || !(IS_WS(*q) || *q == ',' || *q == ']')) {
+			*bad_index = idx;
+			return 0;
+		}
+		idx++;
+		*count = idx;
+		p = skip_ws(q, end);
+		if(p == end) {
+			*bad_index = idx;
+			return 0;
+		}
+		if(*p == ']') break;
+		if(*p != ',') {
+			*bad_index = idx;
+			return 0;
+		}
+		p = skip_ws(p + 1, end);
+	}
+	return skip_ws(p + 1, end) == end;
+}
+
+/*
+Decodes a json array of integers (ex: the val of a JSON_DATATYPE_ARRAY property) into out.
+count: number of elements decoded.
+bad_index: index of the first element that is not a valid int (or doesn't fit in out), -1 if none.
+           On error -1 means the array itself is malformed (no opening '[' or content after the closing ']').
+Returns: 0 = error, 1 = success
+*/
+int minijson_decode_int_array(str *s, int out[], int capacity, int *count, int *bad_index) {
+	return decode_number_array(s, 0, out, capacity, count, bad_index);
+}
+
+/* Same as minijson_decode_int_array for numbers of any kind. Returns: 0 = error, 1 = success */
+int minijson_decode_double_array(str *s, double out[], int capacity, int *count, int *bad_index) {
+	return decode_number_array(s, 1, out, capacity, count, bad_index);
+}
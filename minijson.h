@@ -49,5 +49,160 @@ int minijson_set_uchar_array(char *error_buffer, property_t props[], int count,
 int minijson_set_char_array(char *error_buffer, property_t props[], int count, char *name, char *p);
 
 int minijson_strntoi(const char *str, int size);
+int minijson_decode_int_array(str *s, int out[], int capacity, int *count, int *bad_index);
+int minijson_decode_double_array(str *s, double out[], int capacity, int *count, int *bad_index);
+
+/* chunked parser: bounded memory, huge string values delivered in chunks */
+#define MINIJSON_EVENT_PROPERTY 1 /* complete property */
+#define MINIJSON_EVENT_VALUE_BEGIN 2 /* start of a string value too big to buffer (key is set) */
+#define MINIJSON_EVENT_VALUE_CHUNK 3 /* next piece of that value (in val) */
+#define MINIJSON_EVENT_VALUE_END 4 /* end of that value */
+#define MINIJSON_EVENT_END 5 /* closing bracket of the object */
+
+typedef struct {
+	int type;
+	property_t property;
+} minijson_event;
+
+typedef struct minijson_chunked_parser minijson_chunked_parser;
+
+/* converts len bytes of a value chunk into out (which has room for len bytes). Returns the number of bytes written, -1 = invalid input */
+typedef int (*minijson_chunk_decoder)(minijson_chunked_parser *parser, char *in, int len, char *out);
+
+struct minijson_chunked_parser {
+	char *in; // pointer to current char of the data being fed
+	char *in_end;
+	char *buf; // key and value being collected (buf_size) + decoder output (buf_size)
+	int buf_size;
+	int threshold;
+	int key_len;
+	int val_len;
+	int state;
+	int escaped;
+	int nested_in_string;
+	int depth;
+	char stack[256];
+	minijson_chunk_decoder decoder;
+	int decoder_state; // free for use by the decoder, reset to -1 at the start of each value. Must be -1 again at the end of the value (else it is truncated)
+	char error[1024];
+};
+
+int minijson_chunked_parser_init(minijson_chunked_parser *parser, int buf_size, int threshold);
+void minijson_chunked_parser_free(minijson_chunked_parser *parser);
+void minijson_chunked_parser_set_decoder(minijson_chunked_parser *parser, minijson_chunk_decoder decoder);
+void minijson_chunked_feed(minijson_chunked_parser *parser, char *data, int len);
+int minijson_chunked_next(minijson_chunked_parser *parser, minijson_event *event);
+int minijson_decode_hex(minijson_chunked_parser *parser, char *in, int len, char *out);
+
+typedef struct {
+	unsigned long long key_hash;
+	char *member; // key of the member (at the opening quote)
+} minijson_member_hash;
+
+int minijson_hash(str *s, unsigned long long *hash);
+int minijson_equal(str *a, str *b);
+int minijson_equal_scratch(str *a, str *b, minijson_member_hash scratch[], int scratch_count);
+
+/* compact property layout: 16 bytes, offsets relative to the document base */
+#define MINIJSON_COMPACT_KEY_LEN_MASK 0x00ffffff
+#define MINIJSON_COMPACT_DATATYPE_SHIFT 24
+#define MINIJSON_COMPACT_VISITED 0x10000000
+
+typedef struct {
+	unsigned int key_off;
+	unsigned int val_off;
+	unsigned int val_len;
+	unsigned int key_len_flags; /* key length (24 bits) | datatype (4 bits) | visited (1 bit) */
+} property_compact_t;
+
+str minijson_compact_key(char *base, property_compact_t *property);
+str minijson_compact_val(char *base, property_compact_t *property);
+int minijson_compact_datatype(property_compact_t *property);
+
+int minijson_parse_object_compact(minijson_object_parser *parser, property_compact_t props[], int *count);
+int minijson_find_property_compact_ignorecase(char *base, property_compact_t props[], int count, str name, property_compact_t **property);
+int minijson_find_property_compact(char *base, property_compact_t props[], int count, str name, property_compact_t **property);
+
+int minijson_set_uchar_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned char *p);
+int minijson_set_ushort_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned short *p);
+int minijson_set_int_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, int *p);
+int minijson_set_float_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, float *p);
+int minijson_set_uchar_array_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, unsigned char *p);
+int minijson_set_char_array_compact(char *error_buffer, char *base, property_compact_t props[], int count, char *name, char *p);
+
+/* parsed-document cache (minijson_cache.c, requires -lpthread) */
+typedef struct minijson_cache minijson_cache;
+
+typedef struct {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long entries;
+} minijson_cache_stats;
+
+minijson_cache *minijson_cache_create(int capacity, int max_props, int max_len, int shard_count);
+void minijson_cache_destroy(minijson_cache *cache);
+int minijson_cache_parse_object(minijson_cache *cache, minijson_object_parser *parser, property_t props[], int *count);
+void minijson_cache_get_stats(minijson_cache *cache, minijson_cache_stats *stats);
+unsigned long long minijson_cache_hash(const char *s, int len);
+
+/* parallel parsing of one large document (minijson_parallel.c, requires -lpthread) */
+#define MINIJSON_PARALLEL_MAX_THREADS 64
+
+int minijson_parse_object_parallel(str *s, property_t props[], int *count, int thread_count, char *error_buffer);
+int minijson_parse_array_parallel(str *s, property_t elements[], int *count, int thread_count, char *error_buffer);
+
+/* framing of back-to-back documents read from a stream (minijson_stream.c) */
+typedef struct {
+	char *buf;
+	int size;
+	int start; // first byte not yet handed out
+	int end; // end of data read so far
+	int scan; // next byte to be scanned
+	int frame_start; // start of current document or -1 if between documents
+	int depth;
+	int in_string;
+	int escaped;
+	int eof;
+	char error[1024];
+} minijson_framer;
+
+int minijson_framer_init(minijson_framer *framer, int size);
+void minijson_framer_free(minijson_framer *framer);
+int minijson_framer_read(minijson_framer *framer, int fd);
+int minijson_framer_next(minijson_framer *framer, str *frame);
+
+/* columnar extraction from many flat objects (minijson_columns.c) */
+#define MINIJSON_COLUMN_INT64 1
+#define MINIJSON_COLUMN_DOUBLE 2
+#define MINIJSON_COLUMN_STRING 3
+
+#define minijson_column_is_null(_column, _row) (((_column)->nulls[(_row) >> 3] >> ((_row) & 7)) & 1)
+
+typedef struct {
+	char *name; // set by the caller
+	int type; // set by the caller: MINIJSON_COLUMN_*
+	int name_len;
+	long long *int64s;
+	double *doubles;
+	int *offsets; // string columns: value offset relative to table base
+	int *lengths; // string columns: value length
+	unsigned char *nulls; // bitmap: bit set = row is null (missing or json null)
+} minijson_column;
+
+typedef struct {
+	minijson_column *columns;
+	int column_count;
+	int rows;
+	int capacity;
+	char *base; // buffer holding the documents
+	unsigned char *seen; // per row: columns already set
+	char error[1024];
+} minijson_table;
+
+int minijson_table_init(minijson_table *table, minijson_column columns[], int column_count, char *base);
+void minijson_table_free(minijson_table *table);
+int minijson_table_append(minijson_table *table, str *doc);
+int minijson_table_append_ndjson(minijson_table *table, str *buf);
 
 #endif
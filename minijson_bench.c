@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+
+#include "minijson.h"
+
+#define MAX_PROPERTIES 32
+
+void usage(char *app_name) {
+	printf("Usage:\n");
+	printf("args: %s benchmark iterations\n", app_name);
+	printf("ex:   %s cache 1000000\n", app_name);
+	printf("Details:\n");
+	printf("           benchmark = cache|stream|columns|compact|parallel|decode|equal\n");
+}
+
+double now_usec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+void report(char *name, int iterations, double elapsed_usec) {
+	printf("%-24s %10i iterations %12.0f usec %10.1f nsec/op\n", name, iterations, elapsed_usec, elapsed_usec * 1000.0 / iterations);
+}
+
+void bench_cache(int iterations) {
+	char json[] = "{\"type\": \"heartbeat\", \"node\": \"edge-01\", \"seq\": 12345, \"uptime\": 987654, \"load\": 1.75, \"flags\": [1, 2, 3], \"status\": {\"ok\": true}}";
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	int count;
+	int i;
+	double start;
+	str s;
+	minijson_cache_stats stats;
+	minijson_cache *cache = minijson_cache_create(1024, MAX_PROPERTIES, 4096, 16);
+
+	s.s = json;
+	s.len = strlen(json);
+
+	start = now_usec();
+	for(i=0 ; i<iterations ; ++i) {
+		count = MAX_PROPERTIES;
+		minijson_init_object_parser(&parser, &s);
+		if(!minijson_parse_object(&parser, props, &count)) {
+			printf("ERROR: %s\n", parser.error);
+			return;
+		}
+	}
+	report("cold parse", iterations, now_usec() - start);
+
+	start = now_usec();
+	for(i=0 ; i<iterations ; ++i) {
+		count = MAX_PROPERTIES;
+		minijson_init_object_parser(&parser, &s);
+		if(!minijson_cache_parse_object(cache, &parser, props, &count)) {
+			printf("ERROR: %s\n", parser.error);
+			return;
+		}
+	}
+	report("cache hit path", iterations, now_usec() - start);
+
+	minijson_cache_get_stats(cache, &stats);
+	printf("cache stats: hits=%lu misses=%lu evictions=%lu\n", stats.hits, stats.misses, stats.evictions);
+	minijson_cache_destroy(cache);
+}
+
+/* writer side of bench_stream: sends iterations messages back to back, batched in big writes */
+void stream_writer(int fd, char *msg, int iterations) {
+	char batch[65536];
+	int msg_len = strlen(msg);
+	int per_batch = sizeof(batch) / msg_len;
+	int i, n, off, len;
+
+	for(i=0 ; i<per_batch ; ++i) {
+		memcpy(batch + i * msg_len, msg, msg_len);
+	}
+	while(iterations > 0) {
+		n = iterations < per_batch ? iterations : per_batch;
+		len = n * msg_len;
+		off = 0;
+		while(off < len) {
+			int w = write(fd, batch + off, len - off);
+			if(w < 0) {
+				if(errno == EINTR) continue;
+				return;
+			}
+			off += w;
+		}
+		iterations -= n;
+	}
+}
+
+void bench_stream(int iterations) {
+	char msg[] = "{\"type\": \"sample\", \"node\": \"edge-01\", \"seq\": 12345, \"text\": \"braces {} [] inside\", \"vals\": [1, 2, 3]}\n";
+	minijson_framer framer;
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	int count;
+	int fds[2];
+	int frames = 0;
+	int n;
+	double start, elapsed;
+	struct pollfd pfd;
+	str frame;
+	pid_t pid;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 || !minijson_framer_init(&framer, 65536)) {
+		printf("bench_stream: setup failed\n");
+		return;
+	}
+
+	start = now_usec();
+	pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+		stream_writer(fds[1], msg, iterations);
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+
+	while(1) {
+		n = minijson_framer_read(&framer, fds[0]);
+		if(n < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				poll(&pfd, 1, -1);
+				continue;
+			}
+			printf("bench_stream: read failed: %s\n", framer.error);
+			break;
+		}
+		while(minijson_framer_next(&framer, &frame)) {
+			count = MAX_PROPERTIES;
+			minijson_init_object_parser(&parser, &frame);
+			if(!minijson_parse_object(&parser, props, &count)) {
+				printf("ERROR: %s\n", parser.error);
+				break;
+			}
+			frames++;
+		}
+		if(framer.error[0] != 0) {
+			printf("ERROR: %s\n", framer.error);
+			break;
+		}
+		if(n == 0) break;
+	}
+	elapsed = now_usec() - start;
+	waitpid(pid, NULL, 0);
+
+	report("stream frame+parse", frames, elapsed);
+	printf("throughput: %.1f MB/s, %.0f msgs/s\n", (double)frames * strlen(msg) / elapsed, frames * 1000000.0 / elapsed);
+	close(fds[0]);
+	minijson_framer_free(&framer);
+}
+
+typedef struct {
+	int id;
+	int value;
+	float ratio;
+} bench_record;
+
+void bench_columns(int iterations) {
+	char line[] = "{\"id\": 123456, \"name\": \"sensor-42\", \"value\": 98765, \"ratio\": 1.25, \"unit\": \"ms\"}\n";
+	int line_len = strlen(line);
+	char *buf = malloc(line_len * iterations + 1);
+	bench_record *records = malloc(iterations * sizeof(bench_record));
+	minijson_column columns[3];
+	minijson_table table;
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	char error[1024];
+	int count;
+	int i;
+	double start;
+	str s;
+
+	for(i=0 ; i<iterations ; ++i) {
+		memcpy(buf + i * line_len, line, line_len);
+	}
+	buf[line_len * iterations] = 0;
+
+	start = now_usec();
+	for(i=0 ; i<iterations ; ++i) {
+		s.s = buf + i * line_len;
+		s.len = line_len - 1;
+		count = MAX_PROPERTIES;
+		minijson_init_object_parser(&parser, &s);
+		if(!minijson_parse_object(&parser, props, &count) ||
+		   !minijson_set_int(error, props, count, "id", &records[i].id) ||
+		   !minijson_set_int(error, props, count, "value", &records[i].value)) {
+			printf("ERROR: %s\n", parser.error);
+			return;
+		}
+		records[i].ratio = strtod(props[3].val.s, NULL);
+	}
+	report("parse + set_* (structs)", iterations, now_usec() - start);
+
+	columns[0].name = "id";
+	columns[0].type = MINIJSON_COLUMN_INT64;
+	columns[1].name = "value";
+	columns[1].type = MINIJSON_COLUMN_INT64;
+	columns[2].name = "ratio";
+	columns[2].type = MINIJSON_COLUMN_DOUBLE;
+	s.s = buf;
+	s.len = line_len * iterations;
+
+	start = now_usec();
+	if(!minijson_table_init(&table, columns, 3, buf) || !minijson_table_append_ndjson(&table, &s)) {
+		printf("ERROR: %s\n", table.error);
+		return;
+	}
+	report("columnar ndjson", table.rows, now_usec() - start);
+
+	minijson_table_free(&table);
+	free(records);
+	free(buf);
+}
+
+#define COMPACT_BENCH_KEYS 4000
+
+/* lookup throughput on a large object: every key is looked up once per pass */
+void bench_compact(int iterations) {
+	int size = COMPACT_BENCH_KEYS * 32 + 16;
+	char *json = malloc(size);
+	char (*names)[16] = malloc(COMPACT_BENCH_KEYS * 16);
+	property_t *props = malloc(COMPACT_BENCH_KEYS * sizeof(property_t));
+	property_compact_t *cprops = malloc(COMPACT_BENCH_KEYS * sizeof(property_compact_t));
+	property_t *prop;
+	property_compact_t *cprop;
+	minijson_object_parser parser;
+	int count;
+	int len = 0;
+	int i, j;
+	double start;
+	str s, name;
+
+	len += sprintf(json + len, "{");
+	for(i=0 ; i<COMPACT_BENCH_KEYS ; ++i) {
+		sprintf(names[i], "key%05i", i);
+		len += sprintf(json + len, "%s\"%s\": %i", i ? ", " : "", names[i], i + 1);
+	}
+	len += sprintf(json + len, "}");
+	s.s = json;
+	s.len = len;
+
+	count = COMPACT_BENCH_KEYS;
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object(&parser, props, &count)) {
+		printf("ERROR: %s\n", parser.error);
+		return;
+	}
+	count = COMPACT_BENCH_KEYS;
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object_compact(&parser, cprops, &count)) {
+		printf("ERROR: %s\n", parser.error);
+		return;
+	}
+	printf("props array: %i bytes (property_t) vs %i bytes (property_compact_t), document %i bytes\n",
+		(int)(count * sizeof(property_t)), (int)(count * sizeof(property_compact_t)), len);
+
+	start = now_usec();
+	for(j=0 ; j<iterations ; ++j) {
+		for(i=0 ; i<count ; ++i) props[i].visited = 0;
+		for(i=0 ; i<count ; ++i) {
+			name.s = names[(i * 7919) % count]; /* scattered order */
+			name.len = 8;
+			if(!minijson_find_property(props, count, name, &prop)) {
+				printf("ERROR: %s not found\n", name.s);
+				return;
+			}
+		}
+	}
+	report("find (property_t)", iterations * count, now_usec() - start);
+
+	start = now_usec();
+	for(j=0 ; j<iterations ; ++j) {
+		for(i=0 ; i<count ; ++i) cprops[i].key_len_flags &= ~MINIJSON_COMPACT_VISITED;
+		for(i=0 ; i<count ; ++i) {
+			name.s = names[(i * 7919) % count];
+			name.len = 8;
+			if(!minijson_find_property_compact(json, cprops, count, name, &cprop)) {
+				printf("ERROR: %s not found\n", name.s);
+				return;
+			}
+		}
+	}
+	report("find (compact)", iterations * count, now_usec() - start);
+
+	free(cprops);
+	free(props);
+	free(names);
+	free(json);
+}
+
+/* iterations = number of members of the generated document */
+void bench_parallel(int iterations) {
+	char *record = "{\"id\": 123456, \"name\": \"catalog item with a longer description, {braces} and [brackets]\", \"tags\": [\"a\", \"b\"], \"price\": 12.5}";
+	int size = iterations * (strlen(record) + 24) + 16;
+	char *json = malloc(size);
+	property_t *props = malloc(iterations * sizeof(property_t));
+	minijson_object_parser parser;
+	char error[1024];
+	char name[64];
+	int count;
+	int len = 0;
+	int i, threads;
+	double start;
+	str s;
+
+	len += sprintf(json + len, "{");
+	for(i=0 ; i<iterations ; ++i) {
+		len += sprintf(json + len, "%s\"item%i\": %s", i ? ",\n" : "", i, record);
+	}
+	len += sprintf(json + len, "}");
+	s.s = json;
+	s.len = len;
+	printf("document: %.1f MB, %i members\n", len / 1048576.0, iterations);
+
+	count = iterations;
+	start = now_usec();
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object(&parser, props, &count)) {
+		printf("ERROR: %s\n", parser.error);
+		return;
+	}
+	report("serial parse", 1, now_usec() - start);
+
+	for(threads=1 ; threads<=16 ; threads*=2) {
+		count = iterations;
+		start = now_usec();
+		if(!minijson_parse_object_parallel(&s, props, &count, threads, error)) {
+			printf("ERROR: %s\n", error);
+			return;
+		}
+		sprintf(name, "parallel parse (%i threads)", threads);
+		report(name, 1, now_usec() - start);
+	}
+
+	free(props);
+	free(json);
+}
+
+#define DECODE_BENCH_ELEMENTS 10000
+
+void bench_decode(int iterations) {
+	int size = DECODE_BENCH_ELEMENTS * 16 + 16;
+	char *json = malloc(size);
+	int *ints = malloc(DECODE_BENCH_ELEMENTS * sizeof(int));
+	double *doubles = malloc(DECODE_BENCH_ELEMENTS * sizeof(double));
+	int len = 0;
+	int n, bad_index;
+	int i, j;
+	double start;
+	char *p, *q;
+	str s;
+
+	srand(1);
+	len += sprintf(json + len, "[");
+	for(i=0 ; i<DECODE_BENCH_ELEMENTS ; ++i) {
+		len += sprintf(json + len, "%s%i", i ? ", " : "", (rand() % 200001) - 100000);
+	}
+	len += sprintf(json + len, "]");
+	s.s = json;
+	s.len = len;
+
+	/* what callers do today: split by hand and minijson_strntoi each element */
+	start = now_usec();
+	for(j=0 ; j<iterations ; ++j) {
+		p = json + 1;
+		n = 0;
+		while(*p != ']') {
+			while(*p == ' ' || *p == ',') ++p;
+			q = p;
+			while(*q != ',' && *q != ']') ++q;
+			ints[n++] = minijson_strntoi(p, q - p);
+			p = q;
+		}
+	}
+	report("split + strntoi", iterations * DECODE_BENCH_ELEMENTS, now_usec() - start);
+
+	start = now_usec();
+	for(j=0 ; j<iterations ; ++j) {
+		if(!minijson_decode_int_array(&s, ints, DECODE_BENCH_ELEMENTS, &n, &bad_index)) {
+			printf("ERROR: bad element %i\n", bad_index);
+			return;
+		}
+	}
+	report("decode_int_array", iterations * DECODE_BENCH_ELEMENTS, now_usec() - start);
+
+	start = now_usec();
+	for(j=0 ; j<iterations ; ++j) {
+		if(!minijson_decode_double_array(&s, doubles, DECODE_BENCH_ELEMENTS, &n, &bad_index)) {
+			printf("ERROR: bad element %i\n", bad_index);
+			return;
+		}
+	}
+	report("decode_double_array", iterations * DECODE_BENCH_ELEMENTS, now_usec() - start);
+
+	free(doubles);
+	free(ints);
+	free(json);
+}
+
+/* writes an object with members item0..item(count-1), in reverse order if reversed is set */
+static int equal_bench_doc(char *json, int count, int reversed, char *sep) {
+	int len = 0;
+	int i, k;
+
+	len += sprintf(json + len, "{");
+	for(i=0 ; i<count ; ++i) {
+		k = reversed ? count - 1 - i : i;
+		len += sprintf(json + len, "%s\"item%i\":%s{\"id\": %i, \"tags\": [\"a\", \"b\"]}", i ? "," : "", k, sep, k);
+	}
+	len += sprintf(json + len, "}");
+	return len;
+}
+
+/* iterations = number of members of the compared objects */
+void bench_equal(int iterations) {
+	int size = iterations * 64 + 16;
+	char *ja = malloc(size);
+	char *jb = malloc(size);
+	char *jc = malloc(size);
+	minijson_member_hash *scratch = malloc((iterations + 1) * sizeof(minijson_member_hash));
+	unsigned long long h;
+	double start;
+	str a, b, c;
+
+	a.s = ja;
+	a.len = equal_bench_doc(ja, iterations, 0, "");
+	b.s = jb;
+	b.len = equal_bench_doc(jb, iterations, 0, "\n  ");
+	c.s = jc;
+	c.len = equal_bench_doc(jc, iterations, 1, " ");
+	printf("document: %i bytes, %i members\n", a.len, iterations);
+
+	start = now_usec();
+	if(!minijson_hash(&a, &h)) printf("ERROR: hash failed\n");
+	report("hash", 1, now_usec() - start);
+
+	start = now_usec();
+	if(!minijson_equal(&a, &b)) printf("ERROR: same order not equal\n");
+	report("equal (same order)", 1, now_usec() - start);
+
+	start = now_usec();
+	if(!minijson_equal_scratch(&a, &c, scratch, iterations + 1)) printf("ERROR: reversed not equal\n");
+	report("equal reversed (scratch)", 1, now_usec() - start);
+
+	/* without scratch reordered members are found by scanning: quadratic */
+	if(iterations <= 4000) {
+		start = now_usec();
+		if(!minijson_equal(&a, &c)) printf("ERROR: reversed not equal\n");
+		report("equal reversed (scan)", 1, now_usec() - start);
+	}
+
+	free(scratch);
+	free(jc);
+	free(jb);
+	free(ja);
+}
+
+int main(int argc, char *argv[]) {
+	int iterations;
+
+	if(argc != 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	iterations = atoi(argv[2]);
+	if(iterations <= 0) {
+		printf("Invalid iterations\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(strcmp(argv[1], "cache") == 0) {
+		bench_cache(iterations);
+	} else if(strcmp(argv[1], "stream") == 0) {
+		bench_stream(iterations);
+	} else if(strcmp(argv[1], "columns") == 0) {
+		bench_columns(iterations);
+	} else if(strcmp(argv[1], "compact") == 0) {
+		bench_compact(iterations);
+	} else if(strcmp(argv[1], "parallel") == 0) {
+		bench_parallel(iterations);
+	} else if(strcmp(argv[1], "decode") == 0) {
+		bench_decode(iterations);
+	} else if(strcmp(argv[1], "equal") == 0) {
+		bench_equal(iterations);
+	} else {
+		printf("Invalid benchmark\n");
+		usage(argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,324 @@
+#include "minijson.h"
+#include "minijson_internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/*
+Parsed-document cache.
+
+Entries are keyed by a 64-bit hash of the document bytes. Each entry keeps its
+own copy of the document (so a hash hit can be confirmed with memcmp) and the
+parsed properties stored as offsets relative to the start of the document, so
+a hit only has to rebase them onto the caller's buffer.
+
+The cache is split in shards, each one with its own mutex, hash buckets and LRU
+list, so that threads hitting different documents don't contend on one lock.
+*/
+
+typedef struct {
+	int key_off;
+	int key_len;
+	int val_off;
+	int val_len;
+	int datatype;
+} cached_property;
+
+typedef struct cache_entry {
+	unsigned long long hash;
+	char *doc;
+	int len;
+	int doc_size; /* allocated size of doc */
+	int count;
+	cached_property *props;
+	struct cache_entry *bucket_next;
+	struct cache_entry *lru_prev;
+	struct cache_entry *lru_next;
+	int used;
+} cache_entry;
+
+typedef struct {
+	pthread_mutex_t lock;
+	cache_entry *entries;
+	int capacity;
+	int used;
+	cache_entry **buckets;
+	int bucket_count;
+	cache_entry *lru_head; /* most recently used */
+	cache_entry *lru_tail; /* least recently used */
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} cache_shard;
+
+struct minijson_cache {
+	cache_shard *shards;
+	int shard_count;
+	int max_props;
+	int max_len;
+};
+
+unsigned long long minijson_cache_hash(const char *s, int len) {
+	const unsigned long long m = 0xff51afd7ed558ccdULL;
+	unsigned long long h = 0x9e3779b97f4a7c15ULL ^ ((unsigned long long)len * m);
+	unsigned long long w;
+
+	/* 8 bytes per round. memcpy keeps it safe for unaligned input */
+	while(len >= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * m;
+		h ^= h >> 32;
+		s += 8;
+		len -= 8;
+	}
+	if(len > 0) {
+		w = 0;
+		memcpy(&w, s, len);
+		h = (h ^ w) * m;
+	}
+
+	return minijson_mix64(h);
+}
+
+static void lru_unlink(cache_shard *shard, cache_entry *e) {
+	if(e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+	else shard->lru_head = e->lru_next;
+	if(e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+	else shard->lru_tail = e->lru_prev;
+	e->lru_prev = e->lru_next = 0;
+}
+
+static void lru_push_front(cache_shard *shard, cache_entry *e) {
+	e->lru_prev = 0;
+	e->lru_next = shard->lru_head;
+	if(shard->lru_head) shard->lru_head->lru_prev = e;
+	shard->lru_head = e;
+	if(!shard->lru_tail) shard->lru_tail = e;
+}
+
+static void bucket_unlink(cache_shard *shard, cache_entry *e) {
+	cache_entry **pp = &shard->buckets[(e->hash >> 32) % shard->bucket_count];
+	while(*pp) {
+		if(*pp == e) {
+			*pp = e->bucket_next;
+			break;
+		}
+		pp = &(*pp)->bucket_next;
+	}
+	e->bucket_next = 0;
+}
+
+static cache_entry *shard_lookup(cache_shard *shard, unsigned long long hash, char *doc, int len) {
+	cache_entry *e = shard->buckets[(hash >> 32) % shard->bucket_count];
+	while(e) {
+		if(e->hash == hash && e->len == len && memcmp(e->doc, doc, len) == 0) {
+			return e;
+		}
+		e = e->bucket_next;
+	}
+	return 0;
+}
+
+/* Returns: 1 = props rebased onto doc, 0 = not enough room in props */
+static int entry_rebase(cache_entry *e, char *doc, property_t props[], int max_props) {
+	int i;
+	if(e->count > max_props) return 0;
+	for(i=0 ; i<e->count ; ++i) {
+		props[i].key.s = doc + e->props[i].key_off;
+		props[i].key.len = e->props[i].key_len;
+		props[i].val.s = doc + e->props[i].val_off;
+		props[i].val.len = e->props[i].val_len;
+		props[i].datatype = e->props[i].datatype;
+		props[i].visited = 0;
+	}
+	return 1;
+}
+
+/* Returns: 1 = stored, 0 = out of memory */
+static int entry_store(cache_entry *e, unsigned long long hash, char *doc, int len, property_t props[], int count) {
+	int i;
+	if(e->doc_size < len) {
+		char *d = realloc(e->doc, len);
+		if(!d) return 0;
+		e->doc = d;
+		e->doc_size = len;
+	}
+	memcpy(e->doc, doc, len);
+	e->len = len;
+	e->hash = hash;
+	e->count = count;
+	for(i=0 ; i<count ; ++i) {
+		e->props[i].key_off = props[i].key.s - doc;
+		e->props[i].key_len = props[i].key.len;
+		e->props[i].val_off = props[i].val.s - doc;
+		e->props[i].val_len = props[i].val.len;
+		e->props[i].datatype = props[i].datatype;
+	}
+	return 1;
+}
+
+/*
+capacity: max number of cached documents (spread across shards)
+max_props: max number of properties of a cacheable document
+max_len: documents longer than this are parsed but not cached
+shard_count: number of independently locked shards (1 for single threaded use)
+Returns: the cache or NULL on failure.
+*/
+minijson_cache *minijson_cache_create(int capacity, int max_props, int max_len, int shard_count) {
+	minijson_cache *cache;
+	int i, j;
+
+	if(capacity <= 0 || max_props <= 0 || max_len <= 0 || shard_count <= 0) return 0;
+	if(shard_count > capacity) shard_count = capacity;
+
+	cache = calloc(1, sizeof(minijson_cache));
+	if(!cache) return 0;
+	cache->max_props = max_props;
+	cache->max_len = max_len;
+	cache->shard_count = shard_count;
+	cache->shards = calloc(shard_count, sizeof(cache_shard));
+	if(!cache->shards) {
+		free(cache);
+		return 0;
+	}
+
+	for(i=0 ; i<shard_count ; ++i) {
+		cache_shard *shard = &cache->shards[i];
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->capacity = capacity / shard_count + (i < capacity % shard_count ? 1 : 0);
+		shard->bucket_count = shard->capacity * 2;
+		shard->entries = calloc(shard->capacity, sizeof(cache_entry));
+		shard->buckets = calloc(shard->bucket_count, sizeof(cache_entry*));
+		if(!shard->entries || !shard->buckets) {
+			cache->shard_count = i + 1;
+			minijson_cache_destroy(cache);
+			return 0;
+		}
+		for(j=0 ; j<shard->capacity ; ++j) {
+			shard->entries[j].props = malloc(max_props * sizeof(cached_property));
+			if(!shard->entries[j].props) {
+				cache->shard_count = i + 1;
+				minijson_cache_destroy(cache);
+				return 0;
+			}
+		}
+	}
+	return cache;
+}
+
+void minijson_cache_destroy(minijson_cache *cache) {
+	int i, j;
+	if(!cache) return;
+	for(i=0 ; i<cache->shard_count ; ++i) {
+		cache_shard *shard = &cache->shards[i];
+		if(shard->entries) {
+			for(j=0 ; j<shard->capacity ; ++j) {
+				free(shard->entries[j].doc);
+				free(shard->entries[j].props);
+			}
+		}
+		free(shard->entries);
+		free(shard->buckets);
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(cache->shards);
+	free(cache);
+}
+
+/*
+Drop-in replacement for minijson_parse_object: the parser must have been initialized
+with minijson_init_object_parser. On a hit the document is not parsed at all.
+Returns: 0 = error, 1 = success
+*/
+int minijson_cache_parse_object(minijson_cache *cache, minijson_object_parser *parser, property_t props[], int *count) {
+	char *doc = parser->p;
+	int len = parser->end - parser->p;
+	unsigned long long hash;
+	cache_shard *shard;
+	cache_entry *e;
+	int max_props = *count;
+
+	if(len > cache->max_len) {
+		return minijson_parse_object(parser, props, count);
+	}
+
+	hash = minijson_cache_hash(doc, len);
+	shard = &cache->shards[hash % cache->shard_count];
+
+	pthread_mutex_lock(&shard->lock);
+	e = shard_lookup(shard, hash, doc, len);
+	if(e) {
+		shard->hits++;
+		lru_unlink(shard, e);
+		lru_push_front(shard, e);
+		if(!entry_rebase(e, doc, props, max_props)) {
+			*count = e->count;
+			pthread_mutex_unlock(&shard->lock);
+			sprintf(parser->error, "minijson_cache_parse_object: no space in array for new key (count=%i)", *count);
+			return 0;
+		}
+		*count = e->count;
+		pthread_mutex_unlock(&shard->lock);
+		parser->p = parser->end;
+		parser->next_step = 0;
+		return 1;
+	}
+	shard->misses++;
+	pthread_mutex_unlock(&shard->lock);
+
+	/* parse without holding the lock */
+	if(!minijson_parse_object(parser, props, count)) {
+		return 0;
+	}
+	if(*count > cache->max_props) {
+		return 1;
+	}
+
+	pthread_mutex_lock(&shard->lock);
+	if(!shard_lookup(shard, hash, doc, len)) { /* another thread may have stored it meanwhile */
+		if(shard->used < shard->capacity) {
+			e = &shard->entries[shard->used++];
+		} else {
+			e = shard->lru_tail;
+			lru_unlink(shard, e);
+			if(e->used) {
+				bucket_unlink(shard, e);
+				e->used = 0;
+				shard->evictions++;
+			}
+		}
+		if(entry_store(e, hash, doc, len, props, *count)) {
+			cache_entry **bucket = &shard->buckets[(hash >> 32) % shard->bucket_count];
+			e->bucket_next = *bucket;
+			*bucket = e;
+			e->used = 1;
+		}
+		/* unused entries are kept at the tail so they are picked first */
+		if(e->used) {
+			lru_push_front(shard, e);
+		} else {
+			e->lru_next = 0;
+			e->lru_prev = shard->lru_tail;
+			if(shard->lru_tail) shard->lru_tail->lru_next = e;
+			shard->lru_tail = e;
+			if(!shard->lru_head) shard->lru_head = e;
+		}
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return 1;
+}
+
+void minijson_cache_get_stats(minijson_cache *cache, minijson_cache_stats *stats) {
+	int i;
+	memset(stats, 0, sizeof(minijson_cache_stats));
+	for(i=0 ; i<cache->shard_count ; ++i) {
+		cache_shard *shard = &cache->shards[i];
+		pthread_mutex_lock(&shard->lock);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->entries += shard->used;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
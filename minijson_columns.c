@@ -0,0 +1,235 @@
+#include "minijson.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+Columnar (struct of arrays) extraction.
+
+A set of fields is pulled from many flat objects straight into one typed array
+per field, using the pull parser so no property array is built per record.
+String columns keep offset+length relative to table->base (the buffer holding
+the documents), so nothing is copied. Missing fields and json null are marked
+in a per column null bitmap (bit set = null) and stored as 0.
+*/
+
+#define TABLE_INITIAL_CAPACITY 1024
+
+/* Returns: 1 = success, 0 = invalid integer or overflow */
+static int column_parse_int64(str *val, long long *out) {
+	unsigned long long limit = 0x7fffffffffffffffULL;
+	unsigned long long v = 0;
+	int neg = 0;
+	int i = 0;
+
+	if(val->len > 0 && val->s[0] == '-') {
+		neg = 1;
+		limit += 1;
+		i = 1;
+	}
+	if(i == val->len) return 0;
+	for( ; i<val->len ; ++i) {
+		unsigned int d = (unsigned char)val->s[i] - '0';
+		if(d > 9) return 0;
+		if(v > (limit - d) / 10) return 0;
+		v = v * 10 + d;
+	}
+	*out = neg ? (long long)(0 - v) : (long long)v;
+	return 1;
+}
+
+static int table_grow(minijson_table *table) {
+	int capacity = table->capacity ? table->capacity * 2 : TABLE_INITIAL_CAPACITY;
+	int i;
+
+	for(i=0 ; i<table->column_count ; ++i) {
+		minijson_column *c = &table->columns[i];
+		unsigned char *nulls = realloc(c->nulls, (capacity + 7) / 8);
+		if(!nulls) goto oom;
+		c->nulls = nulls;
+
+		if(c->type == MINIJSON_COLUMN_INT64) {
+			long long *v = realloc(c->int64s, capacity * sizeof(long long));
+			if(!v) goto oom;
+			c->int64s = v;
+		} else if(c->type == MINIJSON_COLUMN_DOUBLE) {
+			double *v = realloc(c->doubles, capacity * sizeof(double));
+			if(!v) goto oom;
+			c->doubles = v;
+		} else {
+			int *o = realloc(c->offsets, capacity * sizeof(int));
+			if(!o) goto oom;
+			c->offsets = o;
+			o = realloc(c->lengths, capacity * sizeof(int));
+			if(!o) goto oom;
+			c->lengths = o;
+		}
+	}
+	table->capacity = capacity;
+	return 1;
+
+oom:
+	sprintf(table->error, "minijson_table: failed to grow columns to %i rows", capacity);
+	return 0;
+}
+
+/*
+columns: name and type of each column must be set by the caller; the buffers are allocated here.
+base: start of the buffer holding the documents; string columns store offsets relative to it.
+Returns: 0 = error, 1 = success
+*/
+int minijson_table_init(minijson_table *table, minijson_column columns[], int column_count, char *base) {
+	int i;
+
+	memset(table, 0, sizeof(minijson_table));
+	table->columns = columns;
+	table->column_count = column_count;
+	table->base = base;
+
+	/* first so that minijson_table_free is safe whatever fails below */
+	for(i=0 ; i<column_count ; ++i) {
+		minijson_column *c = &columns[i];
+		c->int64s = 0;
+		c->doubles = 0;
+		c->offsets = 0;
+		c->lengths = 0;
+		c->nulls = 0;
+	}
+
+	for(i=0 ; i<column_count ; ++i) {
+		minijson_column *c = &columns[i];
+		if(c->type != MINIJSON_COLUMN_INT64 && c->type != MINIJSON_COLUMN_DOUBLE && c->type != MINIJSON_COLUMN_STRING) {
+			sprintf(table->error, "minijson_table_init: invalid type %i for column '%s'", c->type, c->name);
+			return 0;
+		}
+		c->name_len = strlen(c->name);
+	}
+
+	table->seen = calloc(column_count / 8 + 1, 1);
+	if(!table->seen) {
+		sprintf(table->error, "minijson_table_init: failed to allocate %i columns", column_count);
+		return 0;
+	}
+	return table_grow(table);
+}
+
+void minijson_table_free(minijson_table *table) {
+	int i;
+	for(i=0 ; i<table->column_count ; ++i) {
+		minijson_column *c = &table->columns[i];
+		free(c->int64s);
+		free(c->doubles);
+		free(c->offsets);
+		free(c->lengths);
+		free(c->nulls);
+		c->int64s = 0;
+		c->doubles = 0;
+		c->offsets = 0;
+		c->lengths = 0;
+		c->nulls = 0;
+	}
+	free(table->seen);
+	table->seen = 0;
+	table->capacity = 0;
+	table->rows = 0;
+}
+
+/* Returns: 0 = error, 1 = success */
+static int column_store(minijson_table *table, minijson_column *c, int row, property_t *property) {
+	if(property->datatype == JSON_DATATYPE_NULL) {
+		return 1; /* stays null */
+	}
+
+	if(c->type == MINIJSON_COLUMN_INT64) {
+		if(property->datatype != JSON_DATATYPE_NUMBER || !column_parse_int64(&property->val, &c->int64s[row])) {
+			sprintf(table->error, "minijson_table_append: row %i: invalid int64 value '%.*s' for column '%s'", row, property->val.len, property->val.s, c->name);
+			return 0;
+		}
+	} else if(c->type == MINIJSON_COLUMN_DOUBLE) {
+		if(property->datatype != JSON_DATATYPE_NUMBER) {
+			sprintf(table->error, "minijson_table_append: row %i: invalid double value '%.*s' for column '%s'", row, property->val.len, property->val.s, c->name);
+			return 0;
+		}
+		c->doubles[row] = strtod(property->val.s, NULL); /* the function stops at the first non numeric char */
+	} else {
+		if(property->datatype != JSON_DATATYPE_STRING) {
+			sprintf(table->error, "minijson_table_append: row %i: invalid string value '%.*s' for column '%s'", row, property->val.len, property->val.s, c->name);
+			return 0;
+		}
+		c->offsets[row] = property->val.s - table->base;
+		c->lengths[row] = property->val.len;
+	}
+	c->nulls[row >> 3] &= ~(1 << (row & 7));
+	return 1;
+}
+
+/* Appends one row extracted from doc (which must be inside the table base buffer).
+Returns: 0 = error, 1 = success */
+int minijson_table_append(minijson_table *table, str *doc) {
+	minijson_object_parser parser;
+	property_t property;
+	int row = table->rows;
+	int i;
+
+	if(doc->s < table->base) {
+		sprintf(table->error, "minijson_table_append: document is outside of the table base buffer%s", "");
+		return 0;
+	}
+
+	if(row == table->capacity && !table_grow(table)) {
+		return 0;
+	}
+
+	for(i=0 ; i<table->column_count ; ++i) {
+		minijson_column *c = &table->columns[i];
+		c->nulls[row >> 3] |= 1 << (row & 7);
+		if(c->type == MINIJSON_COLUMN_INT64) c->int64s[row] = 0;
+		else if(c->type == MINIJSON_COLUMN_DOUBLE) c->doubles[row] = 0;
+		else c->offsets[row] = c->lengths[row] = 0;
+	}
+	memset(table->seen, 0, table->column_count / 8 + 1);
+
+	minijson_init_object_parser(&parser, doc);
+	while(minijson_next_property(&parser, &property)) {
+		for(i=0 ; i<table->column_count ; ++i) {
+			minijson_column *c = &table->columns[i];
+			if(c->name_len != property.key.len || memcmp(c->name, property.key.s, property.key.len) != 0) continue;
+			if(table->seen[i >> 3] & (1 << (i & 7))) break; /* first occurrence wins, as in minijson_find_property */
+			table->seen[i >> 3] |= 1 << (i & 7);
+			if(!column_store(table, c, row, &property)) return 0;
+			break;
+		}
+	}
+
+	if(parser.error[0] != 0) {
+		sprintf(table->error, "minijson_table_append: row %i: %.900s", row, parser.error);
+		return 0;
+	}
+
+	table->rows++;
+	return 1;
+}
+
+/* Appends one row per line of a newline delimited json buffer. Empty lines are skipped.
+Returns: 0 = error (rows before the failing line are kept), 1 = success */
+int minijson_table_append_ndjson(minijson_table *table, str *buf) {
+	char *p = buf->s;
+	char *end = buf->s + buf->len;
+	char *nl;
+	str line;
+
+	while(p < end) {
+		nl = memchr(p, '\n', end - p);
+		if(!nl) nl = end;
+		line.s = p;
+		line.len = nl - p;
+		while(line.len > 0 && (line.s[line.len-1] == '\r' || line.s[line.len-1] == ' ' || line.s[line.len-1] == '\t')) {
+			line.len--;
+		}
+		if(line.len > 0 && !minijson_table_append(table, &line)) {
+			return 0;
+		}
+		p = nl + 1;
+	}
+	return 1;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "minijson.h"
+
+/*
+Sample epoll based server: accepts TCP connections and prints the properties of
+every json object received. Objects can be sent back to back or newline delimited:
+
+	printf '{"a": 1}{"b": "x"}\n{"c": [1,2]}' | nc 127.0.0.1 9000
+*/
+
+#define MAX_EVENTS 64
+#define MAX_PROPERTIES 32
+#define FRAMER_BUFFER_SIZE 65536
+
+void usage(char *app_name) {
+	printf("Usage:\n");
+	printf("args: %s port\n", app_name);
+	printf("ex:   %s 9000\n", app_name);
+}
+
+int set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0) return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void handle_frame(int fd, str *frame) {
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	int count = MAX_PROPERTIES;
+	int i;
+
+	minijson_init_object_parser(&parser, frame);
+	if(!minijson_parse_object(&parser, props, &count)) {
+		printf("fd=%i ERROR: %s\n", fd, parser.error);
+		return;
+	}
+	for(i=0 ; i<count ; ++i) {
+		printf("fd=%i %.*s => %.*s (datatype=%i)\n", fd, props[i].key.len, props[i].key.s, props[i].val.len, props[i].val.s, props[i].datatype);
+	}
+}
+
+/* Returns: 1 = keep connection, 0 = close it */
+int handle_readable(int fd, minijson_framer *framer) {
+	str frame;
+	int n;
+
+	while(1) {
+		n = minijson_framer_read(framer, fd);
+		if(n < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+			if(errno == EINTR) continue;
+			printf("fd=%i read failed: %s %s\n", fd, strerror(errno), framer->error);
+			return 0;
+		}
+
+		while(minijson_framer_next(framer, &frame)) {
+			handle_frame(fd, &frame);
+		}
+		if(framer->error[0] != 0) {
+			printf("fd=%i ERROR: %s\n", fd, framer->error);
+			return 0;
+		}
+		if(n == 0) return 0;
+	}
+}
+
+typedef struct {
+	int fd;
+	minijson_framer framer;
+} connection;
+
+int main(int argc, char *argv[]) {
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	struct epoll_event events[MAX_EVENTS];
+	int listen_fd;
+	int epoll_fd;
+	int one = 1;
+	int i, n, fd;
+	connection *conn;
+
+	if(argc != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(atoi(argv[1]));
+	if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+		printf("bind/listen failed: %s\n", strerror(errno));
+		return 1;
+	}
+	set_nonblocking(listen_fd);
+
+	epoll_fd = epoll_create(MAX_EVENTS);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; /* NULL marks the listening socket */
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+	while(1) {
+		n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			printf("epoll_wait failed: %s\n", strerror(errno));
+			return 1;
+		}
+
+		for(i=0 ; i<n ; ++i) {
+			conn = events[i].data.ptr;
+			if(!conn) {
+				while((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+					set_nonblocking(fd);
+					conn = malloc(sizeof(connection));
+					if(!conn || !minijson_framer_init(&conn->framer, FRAMER_BUFFER_SIZE)) {
+						free(conn);
+						close(fd);
+						continue;
+					}
+					conn->fd = fd;
+					ev.events = EPOLLIN;
+					ev.data.ptr = conn;
+					epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+				}
+				continue;
+			}
+
+			if(!handle_readable(conn->fd, &conn->framer)) {
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+				close(conn->fd);
+				minijson_framer_free(&conn->framer);
+				free(conn);
+			}
+		}
+	}
+	return 0;
+}
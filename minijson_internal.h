@@ -0,0 +1,16 @@
+#ifndef __MINIJSON_INTERNAL_H__
+#define __MINIJSON_INTERNAL_H__
+
+/* helpers shared by the library sources. Not installed, not part of the api */
+
+/* final avalanche of a 64 bit hash (murmur3 fmix64), shared by minijson_hash and minijson_cache_hash */
+static inline unsigned long long minijson_mix64(unsigned long long h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+#endif
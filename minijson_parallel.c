@@ -0,0 +1,568 @@
+#include "minijson.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/*
+Parallel indexing of the top-level members/elements of one large document.
+
+The buffer is split in chunks, one per thread:
+
+pass 1: every thread scans its chunk once without knowing whether the chunk starts
+        inside a string. Quotes are recognized locally (a quote is escaped when it is
+        preceded by an odd number of backslashes, which only depends on the bytes
+        right before it), so the thread can count the brackets seen under both
+        assumptions: the ones at even quote parity (chunk starts outside a string)
+        and the ones at odd parity (chunk starts inside a string).
+fix-up: a serial pass over the chunks (not over the data) resolves the real string
+        state and nesting depth at the start of each chunk from the quote parity and
+        bracket deltas of the previous chunks.
+pass 2: every thread rescans its chunk with the real state and collects the
+        positions of the top-level separators (',' and ':' at depth 1). Brackets
+        are matched by type within the chunk; the ones left unmatched (closers
+        of brackets opened before the chunk, openers closed after it) are
+        matched in a serial pass over the chunks.
+pass 3: the members/elements between separators are turned into property_t in
+        parallel, with the same spans and datatypes minijson_parse_object produces.
+
+Unlike the serial parser, escaped quotes inside strings are handled.
+*/
+
+#define PARALLEL_MIN_CHUNK 65536
+
+typedef struct {
+	char *s;
+	int count;
+	int capacity;
+} bracket_stack;
+
+typedef struct {
+	char *doc;
+	int doc_len;
+	int begin;
+	int end;
+
+	/* pass 1: index 0 = chunk starts outside a string, 1 = inside */
+	int quote_parity;
+	int delta[2];
+	int min_depth[2];
+
+	/* fix-up */
+	int in_string;
+	int depth;
+
+	/* pass 2 */
+	int *seps;
+	int sep_count;
+	int sep_capacity;
+	int open_pos; // position of the top-level opening bracket or -1
+	int close_pos; // position of the top-level closing bracket or -1
+	bracket_stack opened; // expected closers of the brackets still open at the end of the chunk (outermost first)
+	bracket_stack closed; // closers of brackets opened in previous chunks (in order)
+
+	/* pass 3 */
+	int *all_seps;
+	property_t *props;
+	int is_object;
+	int first_item;
+	int item_count;
+
+	char error[256];
+} parallel_chunk;
+
+typedef void *(*chunk_func)(void *);
+
+/* number of backslashes right before pos (they may belong to the previous chunk) */
+static int backslashes_before(char *doc, int pos) {
+	int n = 0;
+	while(pos > 0 && doc[pos - 1] == '\\') {
+		--pos;
+		++n;
+	}
+	return n;
+}
+
+static void *chunk_pass1(void *arg) {
+	parallel_chunk *c = arg;
+	char *doc = c->doc;
+	int bs = backslashes_before(doc, c->begin);
+	int parity = 0;
+	int depth[2] = {0, 0};
+	int min_depth[2] = {0, 0};
+	int i;
+	char ch;
+
+	for(i=c->begin ; i<c->end ; ++i) {
+		ch = doc[i];
+		if(ch == '\\') {
+			bs++;
+			continue;
+		}
+		if(ch == '"') {
+			if(!(bs & 1)) parity ^= 1;
+		} else if(ch == '{' || ch == '[') {
+			/* outside a string under the assumption whose index equals the parity */
+			depth[parity]++;
+		} else if(ch == '}' || ch == ']') {
+			depth[parity]--;
+			if(depth[parity] < min_depth[parity]) min_depth[parity] = depth[parity];
+		}
+		bs = 0;
+	}
+
+	c->quote_parity = parity;
+	c->delta[0] = depth[0];
+	c->delta[1] = depth[1];
+	c->min_depth[0] = min_depth[0];
+	c->min_depth[1] = min_depth[1];
+	return 0;
+}
+
+static int chunk_add_sep(parallel_chunk *c, int pos) {
+	if(c->sep_count == c->sep_capacity) {
+		int capacity = c->sep_capacity ? c->sep_capacity * 2 : 1024;
+		int *seps = realloc(c->seps, capacity * sizeof(int));
+		if(!seps) {
+			sprintf(c->error, "minijson_parse_parallel: out of memory%s", "");
+			return 0;
+		}
+		c->seps = seps;
+		c->sep_capacity = capacity;
+	}
+	c->seps[c->sep_count++] = pos;
+	return 1;
+}
+
+/* Returns: 1 = success, 0 = out of memory */
+static int bracket_push(bracket_stack *stack, char c) {
+	if(stack->count == stack->capacity) {
+		int capacity = stack->capacity ? stack->capacity * 2 : 64;
+		char *p = realloc(stack->s, capacity);
+		if(!p) return 0;
+		stack->s = p;
+		stack->capacity = capacity;
+	}
+	stack->s[stack->count++] = c;
+	return 1;
+}
+
+/* Returns: 1 = success, 0 = error (message in c->error) */
+static int chunk_bracket(parallel_chunk *c, char ch, int pos) {
+	if(ch == '{' || ch == '[') {
+		if(bracket_push(&c->opened, ch == '{' ? '}' : ']')) return 1;
+	} else if(c->opened.count > 0) {
+		if(c->opened.s[--c->opened.count] == ch) return 1;
+		sprintf(c->error, "minijson_parse_parallel: mismatched '%c' at offset %i", ch, pos);
+		return 0;
+	} else if(bracket_push(&c->closed, ch)) {
+		return 1;
+	}
+	sprintf(c->error, "minijson_parse_parallel: out of memory%s", "");
+	return 0;
+}
+
+static void *chunk_pass2(void *arg) {
+	parallel_chunk *c = arg;
+	char *doc = c->doc;
+	int bs = backslashes_before(doc, c->begin);
+	int in_string = c->in_string;
+	int depth = c->depth;
+	int after_value = 0; /* a nested value was closed at depth 1: only ',' or the closing bracket may follow */
+	int i;
+	char ch;
+
+	c->open_pos = -1;
+	c->close_pos = -1;
+
+	if(!in_string && depth == 1) {
+		/* the nested value may have been closed in the previous chunk */
+		i = c->begin;
+		while(i > 0 && (doc[i-1] == ' ' || doc[i-1] == '\n' || doc[i-1] == '\r' || doc[i-1] == '\t')) --i;
+		after_value = i > 0 && (doc[i-1] == '}' || doc[i-1] == ']');
+	}
+
+	for(i=c->begin ; i<c->end ; ++i) {
+		ch = doc[i];
+		if(in_string) {
+			if(ch == '\\') {
+				bs++;
+				continue;
+			}
+			if(ch == '"' && !(bs & 1)) in_string = 0;
+			bs = 0;
+			continue;
+		}
+
+		if(depth == 0) {
+			if(ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') continue;
+			if((ch == '{' || ch == '[') && c->open_pos < 0 && c->close_pos < 0) {
+				if(!chunk_bracket(c, ch, i)) return 0;
+				c->open_pos = i;
+				depth = 1;
+				continue;
+			}
+			sprintf(c->error, "minijson_parse_parallel: unexpected char '%c' at offset %i outside of the top-level value", ch, i);
+			return 0;
+		}
+
+		if(after_value) {
+			if(ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') continue;
+			if(ch != ',' && ch != '}' && ch != ']') {
+				sprintf(c->error, "minijson_parse_parallel: unexpected char '%c' at offset %i after value", ch, i);
+				return 0;
+			}
+			after_value = 0;
+		}
+
+		if(ch == '"') {
+			in_string = 1;
+			bs = 0;
+		} else if(ch == '{' || ch == '[') {
+			if(!chunk_bracket(c, ch, i)) return 0;
+			depth++;
+		} else if(ch == '}' || ch == ']') {
+			if(!chunk_bracket(c, ch, i)) return 0;
+			depth--;
+			if(depth == 0) c->close_pos = i;
+			else if(depth == 1) after_value = 1;
+		} else if(depth == 1 && (ch == ',' || ch == ':')) {
+			if(!chunk_add_sep(c, i)) return 0;
+		}
+	}
+	return 0;
+}
+
+static void trim(str *s) {
+	while(s->len > 0 && (s->s[0] == ' ' || s->s[0] == '\n' || s->s[0] == '\r' || s->s[0] == '\t')) {
+		s->s++;
+		s->len--;
+	}
+	while(s->len > 0 && (s->s[s->len-1] == ' ' || s->s[s->len-1] == '\n' || s->s[s->len-1] == '\r' || s->s[s->len-1] == '\t')) {
+		s->len--;
+	}
+}
+
+/* Returns: 1 = s is exactly one quoted string (no unescaped quote in between) */
+static int is_single_string(str *s) {
+	int bs = 0;
+	int i;
+	if(s->len < 2 || s->s[0] != '"' || s->s[s->len-1] != '"') return 0;
+	for(i=1 ; i<s->len-1 ; ++i) {
+		if(s->s[i] == '\\') {
+			bs++;
+			continue;
+		}
+		if(s->s[i] == '"' && !(bs & 1)) return 0;
+		bs = 0;
+	}
+	return !(bs & 1); /* closing quote must not be escaped */
+}
+
+/* Returns: 1 = success, 0 = invalid value */
+static int fill_value(parallel_chunk *c, property_t *property, str *val) {
+	trim(val);
+	if(val->len == 0) {
+		sprintf(c->error, "minijson_parse_parallel: missing value at offset %i", (int)(val->s - c->doc));
+		return 0;
+	}
+	if(val->s[0] == '"') {
+		if(val->len < 2 || !is_single_string(val)) {
+			sprintf(c->error, "minijson_parse_parallel: malformed string value at offset %i", (int)(val->s - c->doc));
+			return 0;
+		}
+		property->val.s = val->s + 1;
+		property->val.len = val->len - 2;
+		property->datatype = JSON_DATATYPE_STRING;
+	} else if(val->s[0] == '{' || val->s[0] == '[') {
+		char closing_char = val->s[0] == '{' ? '}' : ']';
+		if(val->s[val->len-1] != closing_char) {
+			sprintf(c->error, "minijson_parse_parallel: malformed object|array value at offset %i", (int)(val->s - c->doc));
+			return 0;
+		}
+		property->val = *val;
+		property->datatype = val->s[0] == '{' ? JSON_DATATYPE_OBJECT : JSON_DATATYPE_ARRAY;
+	} else {
+		property->val = *val;
+		property->datatype = json_get_datatype(val);
+		if(property->datatype == JSON_DATATYPE_INVALID) {
+			sprintf(c->error, "minijson_parse_parallel: invalid string for number/constant '%.*s'", val->len > 32 ? 32 : val->len, val->s);
+			return 0;
+		}
+	}
+	property->visited = 0;
+	return 1;
+}
+
+/*
+all_seps holds: opening bracket, separators, closing bracket.
+For objects separators alternate ':' and ','; member i uses all_seps[2i .. 2i+2].
+For arrays element i uses all_seps[i .. i+1].
+*/
+static void *chunk_pass3(void *arg) {
+	parallel_chunk *c = arg;
+	int i;
+
+	for(i=c->first_item ; i<c->first_item + c->item_count ; ++i) {
+		property_t *property = &c->props[i];
+		str key, val;
+		if(c->is_object) {
+			int k0 = c->all_seps[2*i];
+			int colon = c->all_seps[2*i + 1];
+			int v1 = c->all_seps[2*i + 2];
+			if(i > 0 && c->doc[k0] != ',') {
+				sprintf(c->error, "minijson_parse_parallel: unexpected '%c' at offset %i while waiting for ','", c->doc[k0], k0);
+				return 0;
+			}
+			if(c->doc[colon] != ':') {
+				sprintf(c->error, "minijson_parse_parallel: unexpected '%c' at offset %i while waiting for ':'", c->doc[colon], colon);
+				return 0;
+			}
+			key.s = c->doc + k0 + 1;
+			key.len = colon - k0 - 1;
+			trim(&key);
+			if(key.len < 3 || !is_single_string(&key)) {
+				sprintf(c->error, "minijson_parse_parallel: invalid key at offset %i", k0 + 1);
+				return 0;
+			}
+			property->key.s = key.s + 1;
+			property->key.len = key.len - 2;
+			val.s = c->doc + colon + 1;
+			val.len = v1 - colon - 1;
+		} else {
+			int v0 = c->all_seps[i];
+			int v1 = c->all_seps[i + 1];
+			if(i > 0 && c->doc[v0] != ',') {
+				sprintf(c->error, "minijson_parse_parallel: unexpected '%c' at offset %i", c->doc[v0], v0);
+				return 0;
+			}
+			property->key.s = 0;
+			property->key.len = 0;
+			val.s = c->doc + v0 + 1;
+			val.len = v1 - v0 - 1;
+		}
+		if(!fill_value(c, property, &val)) return 0;
+	}
+	return 0;
+}
+
+/* runs func on every chunk: chunk 0 in the calling thread, the others in new threads */
+static void run_chunks(parallel_chunk *chunks, int n, chunk_func func) {
+	pthread_t threads[MINIJSON_PARALLEL_MAX_THREADS];
+	int started[MINIJSON_PARALLEL_MAX_THREADS];
+	int i;
+
+	for(i=1 ; i<n ; ++i) {
+		started[i] = pthread_create(&threads[i], NULL, func, &chunks[i]) == 0;
+		if(!started[i]) func(&chunks[i]);
+	}
+	func(&chunks[0]);
+	for(i=1 ; i<n ; ++i) {
+		if(started[i]) pthread_join(threads[i], NULL);
+	}
+}
+
+static int chunks_error(parallel_chunk *chunks, int n, char *error_buffer) {
+	int i;
+	for(i=0 ; i<n ; ++i) {
+		if(chunks[i].error[0] != 0) {
+			strcpy(error_buffer, chunks[i].error);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Returns: 0 = error, 1 = success */
+static int parse_parallel(str *s, int is_object, property_t props[], int *count, int thread_count, char *error_buffer) {
+	parallel_chunk chunks[MINIJSON_PARALLEL_MAX_THREADS];
+	int max_props = *count;
+	int n = thread_count;
+	int in_string = 0;
+	int depth = 0;
+	int open_pos = -1;
+	int close_pos = -1;
+	int total_seps = 0;
+	int *all_seps = 0;
+	bracket_stack brackets = {0, 0, 0};
+	int items;
+	int ok = 0;
+	int i, k;
+
+	*count = 0;
+	error_buffer[0] = 0;
+
+	if(n > MINIJSON_PARALLEL_MAX_THREADS) n = MINIJSON_PARALLEL_MAX_THREADS;
+	if(n > s->len / PARALLEL_MIN_CHUNK) n = s->len / PARALLEL_MIN_CHUNK;
+	if(n < 1) n = 1;
+
+	if(n == 1 && is_object) {
+		/* a single chunk would run three passes over the data in one thread: the serial parser is faster */
+		minijson_object_parser parser;
+		*count = max_props;
+		minijson_init_object_parser(&parser, s);
+		if(minijson_parse_object(&parser, props, count)) return 1;
+		strcpy(error_buffer, parser.error);
+		*count = 0;
+		return 0;
+	}
+
+	memset(chunks, 0, sizeof(parallel_chunk) * n);
+	for(i=0 ; i<n ; ++i) {
+		chunks[i].doc = s->s;
+		chunks[i].doc_len = s->len;
+		chunks[i].begin = (int)((long long)s->len * i / n);
+		chunks[i].end = (int)((long long)s->len * (i + 1) / n);
+	}
+
+	/* pass 1: speculative scan */
+	run_chunks(chunks, n, chunk_pass1);
+
+	/* fix-up: real string state and depth at the start of each chunk */
+	for(i=0 ; i<n ; ++i) {
+		chunks[i].in_string = in_string;
+		chunks[i].depth = depth;
+		if(depth + chunks[i].min_depth[in_string] < 0) {
+			sprintf(error_buffer, "minijson_parse_parallel: unbalanced closing bracket%s", "");
+			return 0;
+		}
+		depth += chunks[i].delta[in_string];
+		in_string ^= chunks[i].quote_parity;
+	}
+	if(in_string || depth != 0) {
+		sprintf(error_buffer, "minijson_parse_parallel: unexpected end of string%s", "");
+		return 0;
+	}
+
+	/* pass 2: top-level separators */
+	run_chunks(chunks, n, chunk_pass2);
+	if(chunks_error(chunks, n, error_buffer)) goto end;
+
+	/* brackets left unmatched by the chunks */
+	for(i=0 ; i<n ; ++i) {
+		for(k=0 ; k<chunks[i].closed.count ; ++k) {
+			if(brackets.count == 0 || brackets.s[--brackets.count] != chunks[i].closed.s[k]) {
+				sprintf(error_buffer, "minijson_parse_parallel: mismatched '%c' in chunk %i", chunks[i].closed.s[k], i);
+				goto end;
+			}
+		}
+		for(k=0 ; k<chunks[i].opened.count ; ++k) {
+			if(!bracket_push(&brackets, chunks[i].opened.s[k])) {
+				sprintf(error_buffer, "minijson_parse_parallel: out of memory%s", "");
+				goto end;
+			}
+		}
+	}
+
+	for(i=0 ; i<n ; ++i) {
+		if(chunks[i].open_pos >= 0) {
+			if(open_pos >= 0) {
+				sprintf(error_buffer, "minijson_parse_parallel: garbage after closing bracket%s", "");
+				goto end;
+			}
+			open_pos = chunks[i].open_pos;
+		}
+		if(chunks[i].close_pos >= 0) close_pos = chunks[i].close_pos;
+		total_seps += chunks[i].sep_count;
+	}
+	if(open_pos < 0 || close_pos < 0 || s->s[open_pos] != (is_object ? '{' : '[') || s->s[close_pos] != (is_object ? '}' : ']')) {
+		sprintf(error_buffer, "minijson_parse_parallel: top-level value is not %s", is_object ? "an object" : "an array");
+		goto end;
+	}
+
+	all_seps = malloc((total_seps + 2) * sizeof(int));
+	if(!all_seps) {
+		sprintf(error_buffer, "minijson_parse_parallel: out of memory%s", "");
+		goto end;
+	}
+	k = 0;
+	all_seps[k++] = open_pos;
+	for(i=0 ; i<n ; ++i) {
+		if(chunks[i].sep_count == 0) continue; /* seps is NULL */
+		memcpy(all_seps + k, chunks[i].seps, chunks[i].sep_count * sizeof(int));
+		k += chunks[i].sep_count;
+	}
+	all_seps[k++] = close_pos;
+
+	/* number of members/elements */
+	if(is_object) {
+		if(total_seps == 0) {
+			items = 0;
+		} else if(total_seps % 2 == 0) {
+			sprintf(error_buffer, "minijson_parse_parallel: malformed object%s", "");
+			goto end;
+		} else {
+			items = (total_seps + 1) / 2;
+		}
+	} else {
+		items = total_seps + 1;
+		if(total_seps == 0) {
+			str inner;
+			inner.s = s->s + open_pos + 1;
+			inner.len = close_pos - open_pos - 1;
+			trim(&inner);
+			if(inner.len == 0) items = 0;
+		}
+	}
+	if(items == 0 && is_object) {
+		str inner;
+		inner.s = s->s + open_pos + 1;
+		inner.len = close_pos - open_pos - 1;
+		trim(&inner);
+		if(inner.len != 0) {
+			sprintf(error_buffer, "minijson_parse_parallel: malformed object%s", "");
+			goto end;
+		}
+	}
+	if(items > max_props) {
+		sprintf(error_buffer, "minijson_parse_parallel: no space in array for new key (count=%i)", items);
+		goto end;
+	}
+
+	/* pass 3: build the properties */
+	for(i=0 ; i<n ; ++i) {
+		chunks[i].all_seps = all_seps;
+		chunks[i].props = props;
+		chunks[i].is_object = is_object;
+		chunks[i].first_item = (int)((long long)items * i / n);
+		chunks[i].item_count = (int)((long long)items * (i + 1) / n) - chunks[i].first_item;
+		chunks[i].error[0] = 0;
+	}
+	run_chunks(chunks, n, chunk_pass3);
+	if(chunks_error(chunks, n, error_buffer)) goto end;
+
+	*count = items;
+	ok = 1;
+
+end:
+	free(all_seps);
+	free(brackets.s);
+	for(i=0 ; i<n ; ++i) {
+		free(chunks[i].seps);
+		free(chunks[i].opened.s);
+		free(chunks[i].closed.s);
+	}
+	return ok;
+}
+
+/*
+Parses a top-level object using up to thread_count threads (small documents use fewer).
+props/count work as in minijson_parse_object.
+The three passes do 2 to 3 times the work of minijson_parse_object, so this only
+beats it with 3 or more idle cores. When the document fits in one chunk (under
+128KB or thread_count 1) minijson_parse_object is used instead.
+Returns: 0 = error (message in error_buffer), 1 = success
+*/
+int minijson_parse_object_parallel(str *s, property_t props[], int *count, int thread_count, char *error_buffer) {
+	return parse_parallel(s, 1, props, count, thread_count, error_buffer);
+}
+
+/*
+Parses a top-level array using up to thread_count threads. Each element is returned
+as a property_t with an empty key and val/datatype set as for object values.
+As for objects, 3 or more idle cores are needed to gain over a single thread.
+Returns: 0 = error (message in error_buffer), 1 = success
+*/
+int minijson_parse_array_parallel(str *s, property_t elements[], int *count, int thread_count, char *error_buffer) {
+	return parse_parallel(s, 0, elements, count, thread_count, error_buffer);
+}
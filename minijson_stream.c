@@ -0,0 +1,156 @@
+#include "minijson.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+Framing of back-to-back json documents read from a stream (socket, pipe, ...).
+
+Bytes are read straight into a linear buffer and scanned once to find where each
+top-level object/array ends (tracking strings and escapes so brackets inside
+strings are ignored). Complete documents are handed out as str frames pointing
+into the buffer, so they can be passed to minijson_init_object_parser without
+copying. Documents may be separated by whitespace/newlines or by nothing at all.
+
+Consumed bytes are only reclaimed when the buffer is full (or fully consumed),
+so memmove happens rarely and only for the tail of a partial document.
+
+Frames returned by minijson_framer_next are valid until the next call to
+minijson_framer_read.
+*/
+
+/* Returns: 1 = success, 0 = out of memory */
+int minijson_framer_init(minijson_framer *framer, int size) {
+	memset(framer, 0, sizeof(minijson_framer));
+	framer->buf = malloc(size);
+	if(!framer->buf) {
+		sprintf(framer->error, "minijson_framer_init: failed to allocate %i bytes", size);
+		return 0;
+	}
+	framer->size = size;
+	framer->frame_start = -1;
+	return 1;
+}
+
+void minijson_framer_free(minijson_framer *framer) {
+	free(framer->buf);
+	framer->buf = 0;
+}
+
+static void framer_compact(minijson_framer *framer) {
+	int offset = framer->start;
+	if(offset == 0) return;
+
+	if(framer->end > framer->start) {
+		memmove(framer->buf, framer->buf + offset, framer->end - offset);
+	}
+	framer->start -= offset;
+	framer->end -= offset;
+	framer->scan -= offset;
+	if(framer->frame_start >= 0) framer->frame_start -= offset;
+}
+
+/*
+Reads whatever is available from fd (which is expected to be non-blocking).
+Returns: >0 = bytes read, 0 = end of stream, -1 = error (check errno; EAGAIN/EWOULDBLOCK means no data available).
+If a single document doesn't fit in the buffer, returns -1 with errno set to EMSGSIZE.
+*/
+int minijson_framer_read(minijson_framer *framer, int fd) {
+	int n;
+
+	if(framer->start == framer->end) {
+		/* everything consumed: rewinding is free */
+		framer_compact(framer);
+	} else if(framer->end == framer->size) {
+		if(framer->start == 0) {
+			sprintf(framer->error, "minijson_framer_read: document larger than buffer (size=%i)", framer->size);
+			errno = EMSGSIZE;
+			return -1;
+		}
+		framer_compact(framer);
+	}
+
+	n = read(fd, framer->buf + framer->end, framer->size - framer->end);
+	if(n > 0) {
+		framer->end += n;
+	} else if(n == 0) {
+		framer->eof = 1;
+	}
+	return n;
+}
+
+/* Returns: 1 = got frame, 0 = haven't got frame (more data needed) or error (check framer->error) */
+int minijson_framer_next(minijson_framer *framer, str *frame) {
+	char *buf = framer->buf;
+	int p = framer->scan;
+	int end = framer->end;
+	char c;
+
+	if(framer->error[0] != 0) {
+		return 0;
+	}
+
+	while(p < end) {
+		c = buf[p];
+		if(framer->frame_start < 0) {
+			/* between documents */
+			if(c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+				++p;
+				framer->start = p;
+				continue;
+			}
+			if(c != '{' && c != '[') {
+				sprintf(framer->error, "minijson_framer_next: unexpected char '%c' while searching for start of document", c);
+				framer->scan = p;
+				return 0;
+			}
+			framer->frame_start = p;
+			framer->depth = 1;
+			++p;
+			continue;
+		}
+
+		if(framer->in_string) {
+			/* fast path: skip ordinary string chars */
+			while(p < end && buf[p] != '"' && buf[p] != '\\' && !framer->escaped) {
+				++p;
+			}
+			if(p == end) break;
+			if(framer->escaped) {
+				framer->escaped = 0;
+			} else if(buf[p] == '\\') {
+				framer->escaped = 1;
+			} else {
+				framer->in_string = 0;
+			}
+			++p;
+			continue;
+		}
+
+		if(c == '"') {
+			framer->in_string = 1;
+		} else if(c == '{' || c == '[') {
+			framer->depth++;
+		} else if(c == '}' || c == ']') {
+			framer->depth--;
+			if(framer->depth == 0) {
+				++p;
+				frame->s = buf + framer->frame_start;
+				frame->len = p - framer->frame_start;
+				framer->frame_start = -1;
+				framer->start = p;
+				framer->scan = p;
+				return 1;
+			}
+		}
+		++p;
+	}
+
+	framer->scan = p;
+	if(framer->eof && framer->frame_start >= 0) {
+		sprintf(framer->error, "minijson_framer_next: unexpected end of stream inside document%s", "");
+	}
+	return 0;
+}
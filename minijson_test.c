@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
 #include <sys/select.h>
 #include <sys/time.h>
 
 #include <string.h>
+#include <stdlib.h>
 
 
 #include "minijson.h"
@@ -123,6 +125,463 @@ void test_minijson_set_funcs() {
 	printf("the_uchar: %u\n", the_uchar);
 }
 
+void test_minijson_cache() {
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	int count;
+	int i;
+	minijson_cache_stats stats;
+	minijson_cache *cache = minijson_cache_create(2, MAX_PROPERTIES, 1024, 1);
+	char json1[] = "{\"type\": \"heartbeat\", \"seq\": 1}";
+	char json2[] = "{\"type\": \"config\", \"ttl\": 30}";
+	char json3[] = "{\"type\": \"other\"}";
+	char copy[64];
+	char *docs[5];
+	str s;
+
+	if(!cache) {
+		printf("test_minijson_cache: minijson_cache_create failed\n");
+		return;
+	}
+
+	/* json1 is also parsed from a different buffer to check rebasing */
+	strcpy(copy, json1);
+	docs[0] = json1; docs[1] = copy; docs[2] = json2; docs[3] = json3; docs[4] = json1;
+
+	for(i=0 ; i<5 ; ++i) {
+		s.s = docs[i];
+		s.len = strlen(docs[i]);
+		count = MAX_PROPERTIES;
+		minijson_init_object_parser(&parser, &s);
+		if(!minijson_cache_parse_object(cache, &parser, props, &count)) {
+			printf("test_minijson_cache: minijson_cache_parse_object failed: %s\n", parser.error);
+			continue;
+		}
+		if(props[0].key.s < s.s || props[0].key.s >= s.s + s.len) {
+			printf("test_minijson_cache: property not rebased onto input\n");
+		}
+		printf("cache doc %i: count=%i %.*s => %.*s\n", i, count, props[0].key.len, props[0].key.s, props[0].val.len, props[0].val.s);
+	}
+
+	minijson_cache_get_stats(cache, &stats);
+	/* expected: json1 miss, copy hit, json2 miss, json3 miss (evicts json1), json1 miss (evicts json2) */
+	printf("cache stats: hits=%lu misses=%lu evictions=%lu entries=%lu\n", stats.hits, stats.misses, stats.evictions, stats.entries);
+	minijson_cache_destroy(cache);
+}
+
+void test_minijson_framer() {
+	/* documents back to back, newline delimited, with brackets/quotes inside strings, split across writes */
+	char *pieces[] = {"{\"a\": 1}{\"b\": \"}{\"}\n", "  {\"c\": \"x\\\"]\", \"d\": [1, {\"e\"", ": 2}]}\n[1,2]"};
+	minijson_framer framer;
+	str frame;
+	int fds[2];
+	int i;
+
+	/* small buffer to force compaction */
+	if(pipe(fds) < 0 || !minijson_framer_init(&framer, 40)) {
+		printf("test_minijson_framer: setup failed\n");
+		return;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	for(i=0 ; i<3 ; ++i) {
+		write(fds[1], pieces[i], strlen(pieces[i]));
+		while(minijson_framer_read(&framer, fds[0]) > 0) {
+			while(minijson_framer_next(&framer, &frame)) {
+				printf("frame: %.*s\n", frame.len, frame.s);
+			}
+			if(framer.error[0] != 0) {
+				printf("test_minijson_framer: %s\n", framer.error);
+			}
+		}
+	}
+	close(fds[0]);
+	close(fds[1]);
+	minijson_framer_free(&framer);
+}
+
+void test_minijson_table() {
+	char ndjson[] = "{\"id\": 1, \"name\": \"alice\", \"score\": 1.5}\n"
+		"{\"name\": \"bob\", \"id\": -9223372036854775808}\n"
+		"\n"
+		"{\"id\": 3, \"name\": null, \"score\": 7, \"extra\": [1, 2]}\n";
+	minijson_column columns[3];
+	minijson_table table;
+	str buf;
+	int row;
+
+	columns[0].name = "id";
+	columns[0].type = MINIJSON_COLUMN_INT64;
+	columns[1].name = "name";
+	columns[1].type = MINIJSON_COLUMN_STRING;
+	columns[2].name = "score";
+	columns[2].type = MINIJSON_COLUMN_DOUBLE;
+
+	buf.s = ndjson;
+	buf.len = strlen(ndjson);
+
+	if(!minijson_table_init(&table, columns, 3, ndjson) || !minijson_table_append_ndjson(&table, &buf)) {
+		printf("test_minijson_table: %s\n", table.error);
+		minijson_table_free(&table);
+		return;
+	}
+
+	for(row=0 ; row<table.rows ; ++row) {
+		printf("row %i: id=%lld name=%.*s%s score=%f%s\n", row,
+			columns[0].int64s[row],
+			columns[1].lengths[row], ndjson + columns[1].offsets[row], minijson_column_is_null(&columns[1], row) ? "(null)" : "",
+			columns[2].doubles[row], minijson_column_is_null(&columns[2], row) ? "(null)" : "");
+	}
+	minijson_table_free(&table);
+
+	/* duplicated key beyond the 32nd column: first occurrence must win there too */
+	{
+		char doc[] = "{\"c39\": 1, \"c39\": 2}";
+		char names[40][4];
+		minijson_column wide[40];
+		int i;
+
+		for(i=0 ; i<40 ; ++i) {
+			sprintf(names[i], "c%i", i);
+			wide[i].name = names[i];
+			wide[i].type = MINIJSON_COLUMN_INT64;
+		}
+		buf.s = doc;
+		buf.len = strlen(doc);
+		if(!minijson_table_init(&table, wide, 40, doc) || !minijson_table_append(&table, &buf)) {
+			printf("test_minijson_table: %s\n", table.error);
+		} else {
+			printf("wide table: c39=%lld\n", wide[39].int64s[0]);
+		}
+		minijson_table_free(&table);
+	}
+
+	/* failed init must leave the table safe to free, even with garbage in the column buffers */
+	memset(columns, 0x5a, sizeof(columns));
+	columns[0].name = "id";
+	columns[0].type = 99;
+	columns[1].name = "name";
+	columns[1].type = MINIJSON_COLUMN_STRING;
+	if(!minijson_table_init(&table, columns, 2, ndjson)) {
+		printf("table expected error: %s\n", table.error);
+	}
+	minijson_table_free(&table);
+}
+
+void test_minijson_compact() {
+	char json[] = "{\"the_int\": -123, \"name\": \"abc\", \"byte_array\": \"0a0b\", \"obj\": {\"x\": 1}}";
+	minijson_object_parser parser;
+	property_compact_t props[MAX_PROPERTIES];
+	property_compact_t *prop;
+	int count = MAX_PROPERTIES;
+	char error[1024];
+	unsigned char ba[2];
+	int the_int;
+	int i;
+	str s;
+	str key, val;
+
+	s.s = json;
+	s.len = strlen(json);
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object_compact(&parser, props, &count)) {
+		printf("test_minijson_compact: minijson_parse_object_compact failed: %s\n", parser.error);
+		return;
+	}
+	printf("compact: sizeof(property_compact_t)=%i sizeof(property_t)=%i\n", (int)sizeof(property_compact_t), (int)sizeof(property_t));
+	for(i=0 ; i<count ; ++i) {
+		key = minijson_compact_key(json, &props[i]);
+		val = minijson_compact_val(json, &props[i]);
+		printf("compact: %.*s => %.*s (datatype=%i)\n", key.len, key.s, val.len, val.s, minijson_compact_datatype(&props[i]));
+	}
+
+	if(!minijson_set_int_compact(error, json, props, count, "THE_INT", &the_int) ||
+	   !minijson_set_uchar_array_compact(error, json, props, count, "byte_array", ba)) {
+		printf("test_minijson_compact: set failed: %s\n", error);
+		return;
+	}
+	printf("compact: the_int=%i byte_array=%x %x\n", the_int, ba[0], ba[1]);
+
+	if(minijson_find_property_compact(json, props, count, (str)str_init("the_int"), &prop)) {
+		printf("test_minijson_compact: visited property found again\n");
+	}
+	if(!minijson_find_property_compact(json, props, count, (str)str_init("obj"), &prop)) {
+		printf("test_minijson_compact: property obj not found\n");
+	}
+}
+
+#define HASH_EQUAL_TEST_MEMBERS 16000
+
+void test_minijson_hash_equal() {
+	char *pairs[][2] = {
+		{"{\"a\": 1, \"b\": [1, 2, {\"c\": \"x\"}]}", " {\"b\":[1,2,{\"c\":\"x\"}],\n\"a\":1.0}"},
+		{"{\"name\": \"caf\\u00e9 \\\"A\\\"\", \"n\": -0}", "{\"n\": 0, \"name\": \"caf\xc3\xa9 \\\"\\u0041\\\"\"}"},
+		{"[1, 2, 3]", "[1, 3, 2]"},
+		{"{\"a\": 1, \"b\": 2}", "{\"a\": 1}"},
+		{"{\"a\": 1e2}", "{\"a\": 100}"},
+		{"{\"a\": true}", "{\"a\": \"true\"}"},
+		{"{\"a\": }", "{\"a\": null}"},
+	};
+	unsigned long long ha, hb;
+	int i, ok_a, ok_b;
+	str a, b;
+
+	for(i=0 ; i<(int)(sizeof(pairs)/sizeof(pairs[0])) ; ++i) {
+		a.s = pairs[i][0];
+		a.len = strlen(a.s);
+		b.s = pairs[i][1];
+		b.len = strlen(b.s);
+		ok_a = minijson_hash(&a, &ha);
+		ok_b = minijson_hash(&b, &hb);
+		printf("hash/equal %i: valid=%i/%i same_hash=%i equal=%i\n", i, ok_a, ok_b, ok_a && ok_b && ha == hb, minijson_equal(&a, &b));
+	}
+
+	/* large objects: same order, reversed (using scratch) and one differing value */
+	{
+		int size = HASH_EQUAL_TEST_MEMBERS * 32 + 16;
+		char *ja = malloc(size);
+		char *jb = malloc(size);
+		minijson_member_hash *scratch = malloc(HASH_EQUAL_TEST_MEMBERS * sizeof(minijson_member_hash));
+		int len_a = 0, len_b = 0;
+		int k;
+
+		len_a += sprintf(ja + len_a, "{");
+		len_b += sprintf(jb + len_b, "{");
+		for(i=0 ; i<HASH_EQUAL_TEST_MEMBERS ; ++i) {
+			len_a += sprintf(ja + len_a, "%s\"k%i\": [%i, {\"v\": %i}]", i ? ", " : "", i, i, i);
+			k = HASH_EQUAL_TEST_MEMBERS - 1 - i;
+			len_b += sprintf(jb + len_b, "%s\"k%i\":[%i,{\"v\":%i}]", i ? "," : "", k, k, k);
+		}
+		len_a += sprintf(ja + len_a, "}");
+		len_b += sprintf(jb + len_b, "}");
+		a.s = ja;
+		a.len = len_a;
+		b.s = jb;
+		b.len = len_b;
+
+		printf("hash/equal large: same=%i reversed=%i", minijson_equal(&a, &a), minijson_equal_scratch(&a, &b, scratch, HASH_EQUAL_TEST_MEMBERS));
+		jb[len_b - 4] = '9'; /* last value of k0 */
+		printf(" modified=%i\n", minijson_equal_scratch(&a, &b, scratch, HASH_EQUAL_TEST_MEMBERS));
+
+		free(scratch);
+		free(jb);
+		free(ja);
+	}
+}
+
+#define PARALLEL_TEST_MEMBERS 20000
+
+void test_minijson_parallel() {
+	char *values[] = {"\"a, b: {c} [d]\"", "{\"x\": [1, {\"y\": \"w\"}], \"z\": null}", "-12.5", "true", "\"ends with backslash \\\\\"", "[\"a\", \"b\", {}]", "null", "\"\""};
+	char *bad[] = {"{\"a\": 1,}", "{\"a\": {\"b\":1} {\"c\":2}}", "[{\"a\":1} {\"b\":2}]", "{\"a\": [1] [2], \"z\": 3}", "{\"a\": [{]]}", "{\"a\": [{]], \"b\": 1}"};
+	int nvalues = sizeof(values) / sizeof(values[0]);
+	int size = PARALLEL_TEST_MEMBERS * 64;
+	char *json = malloc(size);
+	property_t *serial = malloc(PARALLEL_TEST_MEMBERS * sizeof(property_t));
+	property_t *parallel = malloc(PARALLEL_TEST_MEMBERS * sizeof(property_t));
+	minijson_object_parser parser;
+	char error[1024];
+	int serial_count = PARALLEL_TEST_MEMBERS;
+	int count;
+	int len = 0;
+	int mismatches = 0;
+	int i, threads;
+	str s;
+
+	len += sprintf(json + len, " {");
+	for(i=0 ; i<PARALLEL_TEST_MEMBERS ; ++i) {
+		len += sprintf(json + len, "%s\n\t\"key%i\" : %s", i ? "," : "", i, values[i % nvalues]);
+	}
+	len += sprintf(json + len, "}\n");
+	s.s = json;
+	s.len = len;
+
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object(&parser, serial, &serial_count)) {
+		printf("test_minijson_parallel: minijson_parse_object failed: %s\n", parser.error);
+		return;
+	}
+
+	for(threads=1 ; threads<=8 ; threads*=2) {
+		count = PARALLEL_TEST_MEMBERS;
+		if(!minijson_parse_object_parallel(&s, parallel, &count, threads, error)) {
+			printf("test_minijson_parallel: minijson_parse_object_parallel failed: %s\n", error);
+			continue;
+		}
+		mismatches = count != serial_count;
+		for(i=0 ; i<count && !mismatches ; ++i) {
+			if(parallel[i].key.s != serial[i].key.s || parallel[i].key.len != serial[i].key.len ||
+			   parallel[i].val.s != serial[i].val.s || parallel[i].val.len != serial[i].val.len ||
+			   parallel[i].datatype != serial[i].datatype) {
+				printf("test_minijson_parallel: member %i differs: %.*s => %.*s\n", i, parallel[i].key.len, parallel[i].key.s, parallel[i].val.len, parallel[i].val.s);
+				mismatches++;
+			}
+		}
+		printf("parallel threads=%i: count=%i serial_count=%i mismatches=%i\n", threads, count, serial_count, mismatches);
+	}
+
+	/* top-level array, escaped quotes, and an error case */
+	strcpy(json, "[1, \"a\\\"]\", {\"b\": 2}, [3]]");
+	s.len = strlen(json);
+	count = PARALLEL_TEST_MEMBERS;
+	if(minijson_parse_array_parallel(&s, parallel, &count, 4, error)) {
+		for(i=0 ; i<count ; ++i) {
+			printf("parallel array element %i: %.*s (datatype=%i)\n", i, parallel[i].val.len, parallel[i].val.s, parallel[i].datatype);
+		}
+	} else {
+		printf("test_minijson_parallel: minijson_parse_array_parallel failed: %s\n", error);
+	}
+
+	/* trailing comma, and content after a nested value */
+	for(i=0 ; i<(int)(sizeof(bad)/sizeof(bad[0])) ; ++i) {
+		/* padded so that the document is split in chunks (smaller objects go to the serial parser) */
+		if(bad[i][0] == '{') {
+			s.len = sprintf(json, "{\"pad\": \"%0*d\", %s", 140000, 0, bad[i] + 1);
+		} else {
+			s.len = sprintf(json, "[\"%0*d\", %s", 140000, 0, bad[i] + 1);
+		}
+		count = PARALLEL_TEST_MEMBERS;
+		if(json[0] == '{' ? minijson_parse_object_parallel(&s, parallel, &count, 4, error) : minijson_parse_array_parallel(&s, parallel, &count, 4, error)) {
+			printf("test_minijson_parallel: accepted %s\n", bad[i]);
+		} else {
+			printf("parallel expected error: %s\n", error);
+		}
+	}
+
+	free(parallel);
+	free(serial);
+	free(json);
+}
+
+void test_minijson_chunked() {
+	char json[512];
+	unsigned char payload[100];
+	unsigned char decoded[100];
+	minijson_chunked_parser parser;
+	minijson_event event;
+	int decoded_len = 0;
+	int chunks = 0;
+	int len = 0;
+	int i, n;
+
+	len += sprintf(json + len, "{\"seq\": 7, \"payload\": \"");
+	for(i=0 ; i<100 ; ++i) {
+		payload[i] = i * 37;
+		len += sprintf(json + len, "%02x", payload[i]);
+	}
+	len += sprintf(json + len, "\", \"meta\": {\"a\": [1, \"}\"]}, \"name\": \"x\\\"y\"}");
+
+	/* buffer much smaller than the payload; the document is fed 7 bytes at a time */
+	if(!minijson_chunked_parser_init(&parser, 64, 32)) {
+		printf("test_minijson_chunked: %s\n", parser.error);
+		return;
+	}
+	minijson_chunked_parser_set_decoder(&parser, minijson_decode_hex);
+
+	for(i=0 ; i<len ; i+=7) {
+		n = len - i < 7 ? len - i : 7;
+		minijson_chunked_feed(&parser, json + i, n);
+		while(minijson_chunked_next(&parser, &event)) {
+			switch(event.type) {
+			case MINIJSON_EVENT_PROPERTY:
+				printf("chunked property: %.*s => %.*s (datatype=%i)\n", event.property.key.len, event.property.key.s, event.property.val.len, event.property.val.s, event.property.datatype);
+				break;
+			case MINIJSON_EVENT_VALUE_BEGIN:
+				printf("chunked value begin: %.*s\n", event.property.key.len, event.property.key.s);
+				break;
+			case MINIJSON_EVENT_VALUE_CHUNK:
+				memcpy(decoded + decoded_len, event.property.val.s, event.property.val.len);
+				decoded_len += event.property.val.len;
+				chunks++;
+				break;
+			case MINIJSON_EVENT_VALUE_END:
+				printf("chunked value end: %.*s decoded %i bytes in %i chunks, match=%i\n", event.property.key.len, event.property.key.s, decoded_len, chunks, decoded_len == 100 && memcmp(decoded, payload, 100) == 0);
+				break;
+			case MINIJSON_EVENT_END:
+				printf("chunked end\n");
+				break;
+			}
+		}
+		if(parser.error[0] != 0) {
+			printf("test_minijson_chunked: %s\n", parser.error);
+			break;
+		}
+	}
+	minijson_chunked_parser_free(&parser);
+
+	/* corrupted payloads: non hex char, odd number of digits */
+	for(i=0 ; i<2 ; ++i) {
+		len = sprintf(json, "{\"payload\": \"%s%s\"}", "00112233445566778899aabbccddeeff00112233", i == 0 ? "zz" : "4");
+		if(!minijson_chunked_parser_init(&parser, 64, 32)) break;
+		minijson_chunked_parser_set_decoder(&parser, minijson_decode_hex);
+		minijson_chunked_feed(&parser, json, len);
+		while(minijson_chunked_next(&parser, &event)) {
+			if(event.type == MINIJSON_EVENT_VALUE_END) printf("test_minijson_chunked: corrupted payload accepted\n");
+		}
+		printf("chunked expected error: %s\n", parser.error);
+		minijson_chunked_parser_free(&parser);
+	}
+}
+
+void test_minijson_decode_arrays() {
+	char json[] = "{\"samples\": [12, 15, -3, 2147483647, -2147483648, 0, 123456789], \"ratios\": [1.5, -0.25, 1e3, 2.5E-2, 12345678901234567890, 7], \"bad\": [1, 2, 03, 4]}";
+	minijson_object_parser parser;
+	property_t props[MAX_PROPERTIES];
+	property_t *prop;
+	int count = MAX_PROPERTIES;
+	int ints[16];
+	double doubles[16];
+	int n, bad_index;
+	int i;
+	str s;
+
+	s.s = json;
+	s.len = strlen(json);
+	minijson_init_object_parser(&parser, &s);
+	if(!minijson_parse_object(&parser, props, &count)) {
+		printf("test_minijson_decode_arrays: minijson_parse_object failed: %s\n", parser.error);
+		return;
+	}
+
+	if(minijson_find_property(props, count, (str)str_init("samples"), &prop) && minijson_decode_int_array(&prop->val, ints, 16, &n, &bad_index)) {
+		printf("samples:");
+		for(i=0 ; i<n ; ++i) printf(" %i", ints[i]);
+		printf("\n");
+	} else {
+		printf("test_minijson_decode_arrays: samples failed\n");
+	}
+
+	if(minijson_find_property(props, count, (str)str_init("ratios"), &prop) && minijson_decode_double_array(&prop->val, doubles, 16, &n, &bad_index)) {
+		printf("ratios:");
+		for(i=0 ; i<n ; ++i) printf(" %g", doubles[i]);
+		printf("\n");
+	} else {
+		printf("test_minijson_decode_arrays: ratios failed\n");
+	}
+
+	if(minijson_find_property(props, count, (str)str_init("bad"), &prop) && !minijson_decode_int_array(&prop->val, ints, 16, &n, &bad_index)) {
+		printf("bad: count=%i bad_index=%i\n", n, bad_index);
+	} else {
+		printf("test_minijson_decode_arrays: bad element accepted\n");
+	}
+
+	/* capacity exceeded */
+	if(!minijson_decode_int_array(&props[0].val, ints, 3, &n, &bad_index)) {
+		printf("samples with capacity 3: count=%i bad_index=%i\n", n, bad_index);
+	} else {
+		printf("test_minijson_decode_arrays: capacity not checked\n");
+	}
+
+	/* malformed array: no element is to blame */
+	s.s = "[1]x";
+	s.len = 4;
+	if(!minijson_decode_int_array(&s, ints, 16, &n, &bad_index)) {
+		printf("trailing content: count=%i bad_index=%i\n", n, bad_index);
+	} else {
+		printf("test_minijson_decode_arrays: trailing content accepted\n");
+	}
+}
+
 int main(int argc, char *argv[]) {
 	// char default_str[] = " { \n\"key1\":1, \"key2\": \"val2\", \"key3\" : 3 , \"key4\"\t:4,\t\"key5\":\"val5\"}";
 	char *s;
@@ -131,6 +590,14 @@ int main(int argc, char *argv[]) {
 	int sleepmode = 0;
 
 	test_minijson_set_funcs();
+	test_minijson_cache();
+	test_minijson_framer();
+	test_minijson_table();
+	test_minijson_compact();
+	test_minijson_hash_equal();
+	test_minijson_parallel();
+	test_minijson_chunked();
+	test_minijson_decode_arrays();
 
 	if(argc != 5) {
 		usage(argv[0]);